@@ -36,11 +36,11 @@ class Aabb {
 
 inline bool Aabb::hit(const Ray &r, double t_min, double t_max) const {
     for (int a = 0; a < 3; a++) {
-        auto invD = 1.0f / r.direction()[a];
+        auto invD = 1.0 / r.direction()[a];
         auto t0 = (min()[a] - r.origin()[a]) * invD;
         auto t1 = (max()[a] - r.origin()[a]) * invD;
 
-        if (invD < 0.0f) {
+        if (invD < 0.0) {
             std::swap(t0, t1);
         }
 
@@ -5,7 +5,7 @@
 
 #include "hittable.h"
 
-class XYRect: public Hittable {
+class XYRect final : public Hittable {
     public:
         double x0, x1, y0, y1, k;
         shared_ptr<Material> mp;
@@ -16,13 +16,43 @@ class XYRect: public Hittable {
             x0(_x0), x1(_x1), y0(_y0), y1(_y1), k(_k), mp(mat) {}
 
         virtual bool hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const override;
+        virtual void hit_packet(
+            RayPacket8 &packet, double t_min, HitRecord recs[RayPacket8::size], uint32_t &hit_mask
+        ) const override;
+
+        virtual PrimitiveKind kind() const override {
+            return PrimitiveKind::XYRect;
+        }
+
+        /// @brief Fills rec for a hit at distance t, which must be inside
+        ///        the rect.
+        void set_hit_record(const Ray &r, double t, HitRecord &rec) const;
+
         virtual bool bounding_box(double time0, double time1, Aabb &output_box) const override {
             output_box = Aabb(Point3(x0, y0, k - 0.0001), Point3(x1, y1, k + 0.0001));
             return true;
         }
+
+        virtual double pdf_value(const Point3 &origin, const Vec3 &v) const override {
+            HitRecord rec;
+            if (!this->hit(Ray(origin, v), 0, INF, rec)) {
+                return 0;
+            }
+
+            auto area = (x1 - x0) * (y1 - y0);
+            auto distance_squared = rec.t * rec.t * v.length_squared();
+            auto cosine = fabs(dot(v, rec.normal) / v.length());
+
+            return distance_squared / (cosine * area);
+        }
+
+        virtual Vec3 random(const Point3 &origin) const override {
+            auto random_point = Point3(random_double2(x0, x1), random_double2(y0, y1), k);
+            return random_point - origin;
+        }
 };
 
-class XZRect: public Hittable {
+class XZRect final : public Hittable {
     public:
         double x0, x1, z0, z1, k;
         shared_ptr<Material> mp;
@@ -33,6 +63,18 @@ class XZRect: public Hittable {
             x0(_x0), x1(_x1), z0(_z0), z1(_z1), k(_k), mp(mat) {}
 
         virtual bool hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const override;
+        virtual void hit_packet(
+            RayPacket8 &packet, double t_min, HitRecord recs[RayPacket8::size], uint32_t &hit_mask
+        ) const override;
+
+        virtual PrimitiveKind kind() const override {
+            return PrimitiveKind::XZRect;
+        }
+
+        /// @brief Fills rec for a hit at distance t, which must be inside
+        ///        the rect.
+        void set_hit_record(const Ray &r, double t, HitRecord &rec) const;
+
         virtual bool bounding_box(double time0, double time1, Aabb &output_box) const override {
             output_box = Aabb(Point3(x0, k - 0.0001, z0), Point3(x1, k + 0.0001, z1));
             return true;
@@ -40,7 +82,7 @@ class XZRect: public Hittable {
 
         virtual double pdf_value(const Point3 &origin, const Vec3 &v) const override {
             HitRecord rec;
-            if (!this->hit(Ray(origin, v), 0.001, INF, rec)) {
+            if (!this->hit(Ray(origin, v), 0, INF, rec)) {
                 return 0;
             }
 
@@ -57,7 +99,7 @@ class XZRect: public Hittable {
         }
 };
 
-class YZRect: public Hittable {
+class YZRect final : public Hittable {
     public:
         double y0, y1, z0, z1, k;
         shared_ptr<Material> mp;
@@ -68,15 +110,46 @@ class YZRect: public Hittable {
             y0(_y0), y1(_y1), z0(_z0), z1(_z1), k(_k), mp(mat) {}
 
         virtual bool hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const override;
+        virtual void hit_packet(
+            RayPacket8 &packet, double t_min, HitRecord recs[RayPacket8::size], uint32_t &hit_mask
+        ) const override;
+
+        virtual PrimitiveKind kind() const override {
+            return PrimitiveKind::YZRect;
+        }
+
+        /// @brief Fills rec for a hit at distance t, which must be inside
+        ///        the rect.
+        void set_hit_record(const Ray &r, double t, HitRecord &rec) const;
+
         virtual bool bounding_box(double time0, double time1, Aabb &output_box) const override {
             output_box = Aabb(Point3(k - 0.0001, y0, z0), Point3(k + 0.0001, y1, z1));
             return true;
         }
+
+        virtual double pdf_value(const Point3 &origin, const Vec3 &v) const override {
+            HitRecord rec;
+            if (!this->hit(Ray(origin, v), 0, INF, rec)) {
+                return 0;
+            }
+
+            auto area = (y1 - y0) * (z1 - z0);
+            auto distance_squared = rec.t * rec.t * v.length_squared();
+            auto cosine = fabs(dot(v, rec.normal) / v.length());
+
+            return distance_squared / (cosine * area);
+        }
+
+        virtual Vec3 random(const Point3 &origin) const override {
+            auto random_point = Point3(k, random_double2(y0, y1), random_double2(z0, z1));
+            return random_point - origin;
+        }
 };
 
 bool XYRect::hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const {
+    RT_STAT_INC(rect_tests);
     auto t = (k - r.origin().z()) / r.direction().z();
-    if (t < t_min || t > t_max) {
+    if (t <= t_min || t > t_max) {
         return false;
     }
 
@@ -87,20 +160,49 @@ bool XYRect::hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const
         return false;
     }
 
-    rec.u = (x - x0) / (x1 - x0);
-    rec.v = (y - y0) / (y1 - y0);
+    set_hit_record(r, t, rec);
+    return true;
+}
+
+void XYRect::set_hit_record(const Ray &r, double t, HitRecord &rec) const {
+    rec.u = (r.origin().x() + t * r.direction().x() - x0) / (x1 - x0);
+    rec.v = (r.origin().y() + t * r.direction().y() - y0) / (y1 - y0);
     rec.t = t;
 
     auto outward_normal = Vec3(0, 0, 1);
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mp;
+    rec.mat_ptr = mp.get();
     rec.p = r.at(t);
-    return true;
+    rec.p[2] = k;  // exactly on the plane, so offset_ray_origin() lifts it off
+}
+
+void XYRect::hit_packet(RayPacket8 &packet, double t_min, HitRecord recs[RayPacket8::size], uint32_t &hit_mask) const {
+    const int n = RayPacket8::size;
+    RT_STAT_ADD(rect_tests, packet.active_count());
+    double ts[n];
+
+    for (int lane = 0; lane < n; lane++) {
+        auto t = (k - packet.org_z[lane]) / packet.dir_z[lane];
+        auto x = packet.org_x[lane] + t * packet.dir_x[lane];
+        auto y = packet.org_y[lane] + t * packet.dir_y[lane];
+
+        bool inside = !(t <= t_min || t > packet.t_max[lane]) && !(x < x0 || x > x1 || y < y0 || y > y1);
+        ts[lane] = inside ? t : INF;
+    }
+
+    for (int lane = 0; lane < n; lane++) {
+        if (packet.is_active(lane) && ts[lane] != INF) {
+            set_hit_record(packet.ray(lane), ts[lane], recs[lane]);
+            packet.t_max[lane] = ts[lane];
+            hit_mask |= 1u << lane;
+        }
+    }
 }
 
 bool XZRect::hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const {
+    RT_STAT_INC(rect_tests);
     auto t = (k - r.origin().y()) / r.direction().y();
-    if (t < t_min || t > t_max) {
+    if (t <= t_min || t > t_max) {
         return false;
     }
 
@@ -111,20 +213,49 @@ bool XZRect::hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const
         return false;
     }
 
-    rec.u = (x - x0) / (x1 - x0);
-    rec.v = (z - z0) / (z1 - z0);
+    set_hit_record(r, t, rec);
+    return true;
+}
+
+void XZRect::set_hit_record(const Ray &r, double t, HitRecord &rec) const {
+    rec.u = (r.origin().x() + t * r.direction().x() - x0) / (x1 - x0);
+    rec.v = (r.origin().z() + t * r.direction().z() - z0) / (z1 - z0);
     rec.t = t;
 
     auto outward_normal = Vec3(0, 1, 0);
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mp;
+    rec.mat_ptr = mp.get();
     rec.p = r.at(t);
-    return true;
+    rec.p[1] = k;  // exactly on the plane, so offset_ray_origin() lifts it off
+}
+
+void XZRect::hit_packet(RayPacket8 &packet, double t_min, HitRecord recs[RayPacket8::size], uint32_t &hit_mask) const {
+    const int n = RayPacket8::size;
+    RT_STAT_ADD(rect_tests, packet.active_count());
+    double ts[n];
+
+    for (int lane = 0; lane < n; lane++) {
+        auto t = (k - packet.org_y[lane]) / packet.dir_y[lane];
+        auto x = packet.org_x[lane] + t * packet.dir_x[lane];
+        auto z = packet.org_z[lane] + t * packet.dir_z[lane];
+
+        bool inside = !(t <= t_min || t > packet.t_max[lane]) && !(x < x0 || x > x1 || z < z0 || z > z1);
+        ts[lane] = inside ? t : INF;
+    }
+
+    for (int lane = 0; lane < n; lane++) {
+        if (packet.is_active(lane) && ts[lane] != INF) {
+            set_hit_record(packet.ray(lane), ts[lane], recs[lane]);
+            packet.t_max[lane] = ts[lane];
+            hit_mask |= 1u << lane;
+        }
+    }
 }
 
 bool YZRect::hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const {
+    RT_STAT_INC(rect_tests);
     auto t = (k - r.origin().x()) / r.direction().x();
-    if (t < t_min || t > t_max) {
+    if (t <= t_min || t > t_max) {
         return false;
     }
 
@@ -135,15 +266,43 @@ bool YZRect::hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const
         return false;
     }
 
-    rec.u = (y - y0) / (y1 - y0);
-    rec.v = (z - z0) / (z1 - z0);
+    set_hit_record(r, t, rec);
+    return true;
+}
+
+void YZRect::set_hit_record(const Ray &r, double t, HitRecord &rec) const {
+    rec.u = (r.origin().y() + t * r.direction().y() - y0) / (y1 - y0);
+    rec.v = (r.origin().z() + t * r.direction().z() - z0) / (z1 - z0);
     rec.t = t;
 
     auto outward_normal = Vec3(1, 0, 0);
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mp;
+    rec.mat_ptr = mp.get();
     rec.p = r.at(t);
-    return true;
+    rec.p[0] = k;  // exactly on the plane, so offset_ray_origin() lifts it off
+}
+
+void YZRect::hit_packet(RayPacket8 &packet, double t_min, HitRecord recs[RayPacket8::size], uint32_t &hit_mask) const {
+    const int n = RayPacket8::size;
+    RT_STAT_ADD(rect_tests, packet.active_count());
+    double ts[n];
+
+    for (int lane = 0; lane < n; lane++) {
+        auto t = (k - packet.org_x[lane]) / packet.dir_x[lane];
+        auto y = packet.org_y[lane] + t * packet.dir_y[lane];
+        auto z = packet.org_z[lane] + t * packet.dir_z[lane];
+
+        bool inside = !(t <= t_min || t > packet.t_max[lane]) && !(y < y0 || y > y1 || z < z0 || z > z1);
+        ts[lane] = inside ? t : INF;
+    }
+
+    for (int lane = 0; lane < n; lane++) {
+        if (packet.is_active(lane) && ts[lane] != INF) {
+            set_hit_record(packet.ray(lane), ts[lane], recs[lane]);
+            packet.t_max[lane] = ts[lane];
+            hit_mask |= 1u << lane;
+        }
+    }
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,91 @@
+#ifndef ALIAS_TABLE_H
+#define ALIAS_TABLE_H
+
+#include "rtweekend.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+/// @brief Samples an index with probability proportional to its weight in
+///        constant time, by Vose's alias method. Each bin holds the chance
+///        of keeping its own index and the index it otherwise hands over
+///        to, so one uniform number picks a bin and decides between the two.
+class AliasTable {
+    public:
+        AliasTable() {}
+
+        /// @param weights Non-negative; all zero (or empty) gives a uniform
+        ///        table
+        explicit AliasTable(__F_IN__ const std::vector<double> &weights);
+
+        /// @param u Uniform in [0, 1)
+        size_t sample(__F_IN__ double u) const;
+
+        /// @brief Probability that sample() returns index `i`.
+        double pmf(__F_IN__ size_t i) const { return pmfs[i]; }
+
+        size_t size() const { return bins.size(); }
+
+    private:
+        struct Bin {
+            double keep = 1;
+            uint32_t alias = 0;
+        };
+
+        std::vector<Bin> bins;
+        std::vector<double> pmfs;
+};
+
+AliasTable::AliasTable(const std::vector<double> &weights) : bins(weights.size()), pmfs(weights.size()) {
+    const size_t n = weights.size();
+    double total = 0;
+    for (auto w : weights) {
+        total += w;
+    }
+    for (size_t i = 0; i < n; i++) {
+        pmfs[i] = total > 0 ? weights[i] / total : 1.0 / n;
+    }
+
+    // Scaled so the average bin holds exactly 1, then every under-full
+    // bin is topped up from an over-full one.
+    std::vector<double> scaled(n);
+    std::vector<uint32_t> under, over;
+    for (size_t i = 0; i < n; i++) {
+        scaled[i] = pmfs[i] * n;
+        (scaled[i] < 1 ? under : over).push_back(static_cast<uint32_t>(i));
+    }
+
+    while (!under.empty() && !over.empty()) {
+        auto short_bin = under.back();
+        auto tall_bin = over.back();
+        under.pop_back();
+
+        bins[short_bin].keep = scaled[short_bin];
+        bins[short_bin].alias = tall_bin;
+
+        scaled[tall_bin] -= 1 - scaled[short_bin];
+        if (scaled[tall_bin] < 1) {
+            over.pop_back();
+            under.push_back(tall_bin);
+        }
+    }
+
+    // Whatever is left is 1 up to rounding.
+    for (auto i : under) {
+        bins[i].keep = 1;
+        bins[i].alias = i;
+    }
+    for (auto i : over) {
+        bins[i].keep = 1;
+        bins[i].alias = i;
+    }
+}
+
+size_t AliasTable::sample(double u) const {
+    auto scaled = u * bins.size();
+    auto i = std::min(static_cast<size_t>(scaled), bins.size() - 1);
+    return scaled - i < bins[i].keep ? i : bins[i].alias;
+}
+
+#endif
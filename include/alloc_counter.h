@@ -0,0 +1,80 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+/// @brief Heap allocations made by one thread since it started.
+struct AllocStats {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+};
+
+/// @brief The calling thread's allocation counters. They only move when the
+///        program is built with RT_COUNT_ALLOCS, which replaces the global
+///        operator new below; otherwise they stay at zero.
+inline AllocStats &thread_alloc_stats() {
+    thread_local AllocStats stats;
+    return stats;
+}
+
+#ifdef RT_COUNT_ALLOCS
+
+// Replacement allocation functions. They are not inline, so this header must
+// be included from exactly one translation unit (src/main.cpp).
+
+inline void *counted_alloc(std::size_t size, std::size_t alignment) {
+    auto &stats = thread_alloc_stats();
+    stats.count++;
+    stats.bytes += size;
+
+    if (size == 0) {
+        size = 1;
+    }
+
+    void *p;
+    if (alignment <= alignof(std::max_align_t)) {
+        p = std::malloc(size);
+    } else {
+#ifdef _MSC_VER
+        p = _aligned_malloc(size, alignment);
+#else
+        p = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+    }
+
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+inline void counted_free(void *p, std::size_t alignment) noexcept {
+#ifdef _MSC_VER
+    if (alignment > alignof(std::max_align_t)) {
+        _aligned_free(p);
+        return;
+    }
+#endif
+    std::free(p);
+}
+
+void *operator new(std::size_t size) { return counted_alloc(size, 0); }
+void *operator new[](std::size_t size) { return counted_alloc(size, 0); }
+void *operator new(std::size_t size, std::align_val_t al) { return counted_alloc(size, static_cast<std::size_t>(al)); }
+void *operator new[](std::size_t size, std::align_val_t al) { return counted_alloc(size, static_cast<std::size_t>(al)); }
+
+void operator delete(void *p) noexcept { counted_free(p, 0); }
+void operator delete[](void *p) noexcept { counted_free(p, 0); }
+void operator delete(void *p, std::size_t) noexcept { counted_free(p, 0); }
+void operator delete[](void *p, std::size_t) noexcept { counted_free(p, 0); }
+void operator delete(void *p, std::align_val_t al) noexcept { counted_free(p, static_cast<std::size_t>(al)); }
+void operator delete[](void *p, std::align_val_t al) noexcept { counted_free(p, static_cast<std::size_t>(al)); }
+void operator delete(void *p, std::size_t, std::align_val_t al) noexcept { counted_free(p, static_cast<std::size_t>(al)); }
+void operator delete[](void *p, std::size_t, std::align_val_t al) noexcept { counted_free(p, static_cast<std::size_t>(al)); }
+
+#endif
+
+#endif
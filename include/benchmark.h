@@ -0,0 +1,216 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "rtweekend.h"
+
+#include "lights.h"
+#include "linear_bvh.h"
+#include "wavefront.h"
+
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+/// @brief One timed render at a given thread count.
+struct BenchmarkRun {
+    int threads;
+    double render_ms;
+};
+
+/// @brief Everything measured for one scene by `rtc --benchmark`.
+struct BenchmarkResult {
+    std::string scene;
+    int width = 0;
+    int height = 0;
+    int samples_per_pixel = 0;
+    int max_depth = 0;
+
+    double scene_build_ms = 0;          ///< Building the objects, nested BVHs and textures
+    BVHBuildStats bvh;                  ///< The top-level scene BVH
+    std::vector<NamedBVHStats> inner_bvhs;  ///< BVHs nested in the scene, built with it
+
+    int wavefront_threads = 0;
+    double wavefront_ms = 0;
+    WavefrontIntegrator::Stats wavefront;   ///< Summed over threads
+
+    std::vector<BenchmarkRun> recursive;
+    bool integrators_match = false;     ///< Both integrators made the same image
+    long peak_rss_kb = 0;               ///< Process peak so far; benchmark one SCENE per run to compare
+
+    uint64_t total_rays() const {
+        return wavefront.primary_rays + wavefront.secondary_rays + wavefront.shadow_rays;
+    }
+};
+
+/// @brief 1, 2, 4, ... up to and including `max_threads`.
+inline std::vector<int> benchmark_thread_counts(int max_threads) {
+    std::vector<int> counts;
+    for (int t = 1; t < max_threads; t *= 2) {
+        counts.push_back(t);
+    }
+    counts.push_back(max_threads);
+    return counts;
+}
+
+/// @brief Peak resident set size of the process in KiB, 0 where unknown.
+inline long peak_rss_kb() {
+#ifdef _WIN32
+    return 0;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+/// @brief Millions of rays per second; 0 when nothing was timed.
+inline double mrays_per_second(uint64_t rays, double ms) {
+    return ms > 0 ? rays / (ms * 1000.0) : 0.0;
+}
+
+inline std::string json_string(const std::string &s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+inline std::string bvh_json(const BVHBuildStats &stats) {
+    std::ostringstream out;
+    out << std::setprecision(6)
+        << "{ \"build_ms\": " << stats.build_ms
+        << ", \"primitives\": " << stats.primitive_count
+        << ", \"nodes\": " << stats.node_count
+        << ", \"leaves\": " << stats.leaf_count
+        << ", \"depth\": " << stats.max_depth << " }";
+    return out.str();
+}
+
+/// @brief Writes the results as one JSON document. Stage times are summed
+///        over threads, so per-stage Mrays/s are per thread; the recursive
+///        runs give wall-clock Mrays/s and the speedup over one thread.
+inline void write_benchmark_json(
+    __F_INOUT__ std::ostream &out,
+    __F_IN__ const std::vector<BenchmarkResult> &results,
+    __F_IN__ int max_threads,
+    __F_IN__ LightSelection light_selection
+) {
+    auto flags = out.flags();
+    out << std::setprecision(6);
+
+    out << "{\n"
+        << "  \"format_version\": 1,\n"
+#ifdef __VERSION__
+        << "  \"compiler\": " << json_string(__VERSION__) << ",\n"
+#endif
+        << "  \"max_threads\": " << max_threads << ",\n"
+        << "  \"light_sampling\": " << json_string(light_selection_name(light_selection)) << ",\n"
+        << "  \"precision\": " << json_string(sizeof(Real) == sizeof(float) ? "float" : "double") << ",\n"
+        << "  \"vec3_simd\": " << (Vec3Layout<Real>::size == 4 ? "true" : "false") << ",\n"
+        << "  \"type_bytes\": { \"vec3\": " << sizeof(Vec3) << ", \"ray\": " << sizeof(Ray)
+        << ", \"hit_record\": " << sizeof(HitRecord) << ", \"scatter_record\": " << sizeof(ScatterRecord) << " },\n"
+        << "  \"rng_seed\": " << rng_global_seed() << ",\n"
+        << "  \"scenes\": [";
+
+    for (size_t r = 0; r < results.size(); r++) {
+        const auto &res = results[r];
+        const auto &w = res.wavefront;
+        double single_thread_ms = res.recursive.empty() ? 0.0 : res.recursive.front().render_ms;
+
+        out << (r ? "," : "") << "\n    {\n"
+            << "      \"name\": " << json_string(res.scene) << ",\n"
+            << "      \"width\": " << res.width << ",\n"
+            << "      \"height\": " << res.height << ",\n"
+            << "      \"spp\": " << res.samples_per_pixel << ",\n"
+            << "      \"max_depth\": " << res.max_depth << ",\n"
+            << "      \"scene_build_ms\": " << res.scene_build_ms << ",\n"
+            << "      \"bvh\": " << bvh_json(res.bvh) << ",\n"
+            << "      \"inner_bvhs\": [";
+
+        for (size_t k = 0; k < res.inner_bvhs.size(); k++) {
+            const auto &inner = res.inner_bvhs[k];
+            out << (k ? "," : "") << "\n        { \"name\": " << json_string(inner.name)
+                << ", \"bvh\": " << bvh_json(inner.stats) << " }";
+        }
+
+        out << (res.inner_bvhs.empty() ? "" : "\n      ") << "],\n"
+            << "      \"rays\": { \"primary\": " << w.primary_rays << ", \"secondary\": " << w.secondary_rays
+            << ", \"shadow\": " << w.shadow_rays << " },\n"
+            << "      \"wavefront\": {\n"
+            << "        \"threads\": " << res.wavefront_threads << ",\n"
+            << "        \"render_ms\": " << res.wavefront_ms << ",\n"
+            << "        \"mrays_per_s\": " << mrays_per_second(res.total_rays(), res.wavefront_ms) << ",\n"
+            << "        \"stage_ms\": { \"generate\": " << w.generate_ms
+            << ", \"intersect_primary\": " << w.primary_intersect_ms
+            << ", \"intersect_secondary\": " << w.secondary_intersect_ms
+            << ", \"shade\": " << w.shade_ms
+            << ", \"sample_lights\": " << w.sample_ms
+            << ", \"trace_shadows\": " << w.shadow_ms
+            << ", \"compact\": " << w.compact_ms << " },\n"
+            << "        \"intersect_mrays_per_s_per_thread\": { \"primary\": "
+            << mrays_per_second(w.primary_rays, w.primary_intersect_ms)
+            << ", \"secondary\": " << mrays_per_second(w.secondary_rays, w.secondary_intersect_ms) << " }\n"
+            << "      },\n"
+            << "      \"recursive\": [";
+
+        for (size_t k = 0; k < res.recursive.size(); k++) {
+            const auto &run = res.recursive[k];
+            out << (k ? "," : "") << "\n        { \"threads\": " << run.threads
+                << ", \"render_ms\": " << run.render_ms
+                << ", \"mrays_per_s\": " << mrays_per_second(res.total_rays(), run.render_ms)
+                << ", \"speedup\": " << (run.render_ms > 0 ? single_thread_ms / run.render_ms : 0.0) << " }";
+        }
+
+        out << "\n      ],\n"
+            << "      \"integrators_match\": " << (res.integrators_match ? "true" : "false") << ",\n"
+            << "      \"peak_rss_kb\": " << res.peak_rss_kb << "\n"
+            << "    }";
+    }
+
+    out << "\n  ]\n}\n";
+    out.flags(flags);
+}
+
+/// @brief One line per scene for a human reading the terminal.
+inline void print_benchmark_summary(__F_INOUT__ std::ostream &out, __F_IN__ const std::vector<BenchmarkResult> &results) {
+    for (const auto &res : results) {
+        const auto &w = res.wavefront;
+        double stage_ms = w.generate_ms + w.primary_intersect_ms + w.secondary_intersect_ms
+                        + w.shade_ms + w.sample_ms + w.shadow_ms + w.compact_ms;
+        auto share = [&](double ms) { return stage_ms > 0 ? static_cast<int>(100 * ms / stage_ms + 0.5) : 0; };
+        const auto &best = res.recursive.back();
+
+        out << std::left << std::setw(20) << res.scene << std::right
+            << " bvh " << res.bvh.build_ms << "ms, "
+            << res.total_rays() / 1e6 << "M rays, "
+            << "recursive " << mrays_per_second(res.total_rays(), best.render_ms) << " Mrays/s on " << best.threads << " thread(s), "
+            << "wavefront intersect/shade/sample " << share(w.primary_intersect_ms + w.secondary_intersect_ms + w.shadow_ms)
+            << "/" << share(w.shade_ms) << "/" << share(w.generate_ms + w.sample_ms) << "%"
+            << (res.integrators_match ? "" : " (INTEGRATORS DIFFER)") << '\n';
+    }
+}
+
+#endif
@@ -3,43 +3,149 @@
 
 #include "rtweekend.h"
 
-#include "aarect.h"
-#include "hittable_list.h"
+#include "hittable.h"
 
-class Box : public Hittable {
+#include <utility>
+
+/// @brief An axis-aligned box, intersected with one slab test. The face the
+///        ray enters through (or leaves through, when the entry is before
+///        t_min) gives the hit point, the outward normal, and u, v laid out
+///        as the rect on that face would have them.
+class Box final : public Hittable {
     public:
         Point3 box_min;
         Point3 box_max;
-        HittableList sides;
+        shared_ptr<Material> mp;
 
     public:
         Box() {}
-        Box(const Point3 &p0, const Point3 &p1, shared_ptr<Material> mp);
+        Box(const Point3 &p0, const Point3 &p1, shared_ptr<Material> mp) : box_min(p0), box_max(p1), mp(mp) {}
 
         virtual bool hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const override;
+        virtual void hit_packet(
+            RayPacket8 &packet, double t_min, HitRecord recs[RayPacket8::size], uint32_t &hit_mask
+        ) const override;
 
         virtual bool bounding_box(double time0, double time1, Aabb &output_box) const override {
             output_box = Aabb(box_min, box_max);
             return true;
         }
+
+        virtual PrimitiveKind kind() const override {
+            return PrimitiveKind::Box;
+        }
+
+        /// @brief The face a ray with origin o and direction d hits first
+        ///        after t_min: the axis it is perpendicular to and its
+        ///        coordinate there. Returns false on a miss. Only the slab
+        ///        selection uses the reciprocal; t is then divided out
+        ///        exactly like a rect's, so edges and t match the old
+        ///        six-rect box.
+        static bool slab(
+            const double o[3], const double d[3], const double lo[3], const double hi[3],
+            double t_min, double t_max, double &t, int &axis, double &k
+        );
+
+        /// @brief Fills rec for a hit on the face slab() picked.
+        void set_hit_record(const Ray &r, double t, int axis, double k, HitRecord &rec) const;
 };
 
-Box::Box(const Point3 &p0, const Point3 &p1, shared_ptr<Material> mp) {
-    box_min = p0;
-    box_max = p1;
+inline bool Box::slab(
+    const double o[3], const double d[3], const double lo[3], const double hi[3],
+    double t_min, double t_max, double &t, int &axis, double &k
+) {
+    double t_near = -INF;
+    double t_far = INF;
+    int near_axis = 0;
+    int far_axis = 0;
 
-    sides.add(make_shared<XYRect>(p0.x(), p1.x(), p0.y(), p1.y(), p1.z(), mp));
-    sides.add(make_shared<XYRect>(p0.x(), p1.x(), p0.y(), p1.y(), p0.z(), mp));
+    for (int a = 0; a < 3; a++) {
+        double inv_d = 1.0 / d[a];
+        double t0 = (lo[a] - o[a]) * inv_d;
+        double t1 = (hi[a] - o[a]) * inv_d;
+        if (inv_d < 0) {
+            std::swap(t0, t1);
+        }
+        if (t0 > t_near) {
+            t_near = t0;
+            near_axis = a;
+        }
+        if (t1 < t_far) {
+            t_far = t1;
+            far_axis = a;
+        }
+    }
+
+    if (t_near > t_far) {
+        return false;
+    }
 
-    sides.add(make_shared<XZRect>(p0.x(), p1.x(), p0.z(), p1.z(), p1.y(), mp));
-    sides.add(make_shared<XZRect>(p0.x(), p1.x(), p0.z(), p1.z(), p0.y(), mp));
+    if (t_near > t_min) {
+        axis = near_axis;
+        k = d[axis] < 0 ? hi[axis] : lo[axis];
+    } else {
+        axis = far_axis;
+        k = d[axis] < 0 ? lo[axis] : hi[axis];
+    }
 
-    sides.add(make_shared<YZRect>(p0.y(), p1.y(), p0.z(), p1.z(), p1.x(), mp));
-    sides.add(make_shared<YZRect>(p0.y(), p1.y(), p0.z(), p1.z(), p0.x(), mp));
+    t = (k - o[axis]) / d[axis];
+    return !(t <= t_min || t > t_max);
+}
+
+void Box::set_hit_record(const Ray &r, double t, int axis, double k, HitRecord &rec) const {
+    int u_axis = axis == 0 ? 1 : 0;
+    int v_axis = axis == 2 ? 1 : 2;
+
+    rec.t = t;
+    rec.p = r.at(t);
+    rec.p[axis] = k;    // exactly on the face, so offset_ray_origin() lifts it off
+    rec.u = (r.origin()[u_axis] + t * r.direction()[u_axis] - box_min[u_axis]) / (box_max[u_axis] - box_min[u_axis]);
+    rec.v = (r.origin()[v_axis] + t * r.direction()[v_axis] - box_min[v_axis]) / (box_max[v_axis] - box_min[v_axis]);
+
+    Vec3 outward_normal;
+    outward_normal[axis] = k == box_max[axis] ? 1 : -1;
+    rec.set_face_normal(r, outward_normal);
+    rec.mat_ptr = mp.get();
 }
 
 bool Box::hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const {
-    return sides.hit(r, t_min, t_max, rec);
+    RT_STAT_INC(box_tests);
+    const double o[3] = { r.origin()[0], r.origin()[1], r.origin()[2] };
+    const double d[3] = { r.direction()[0], r.direction()[1], r.direction()[2] };
+    const double lo[3] = { box_min[0], box_min[1], box_min[2] };
+    const double hi[3] = { box_max[0], box_max[1], box_max[2] };
+
+    double t, k;
+    int axis;
+    if (!slab(o, d, lo, hi, t_min, t_max, t, axis, k)) {
+        return false;
+    }
+
+    set_hit_record(r, t, axis, k, rec);
+    return true;
+}
+
+void Box::hit_packet(RayPacket8 &packet, double t_min, HitRecord recs[RayPacket8::size], uint32_t &hit_mask) const {
+    const int n = RayPacket8::size;
+    RT_STAT_ADD(box_tests, packet.active_count());
+    const double lo[3] = { box_min[0], box_min[1], box_min[2] };
+    const double hi[3] = { box_max[0], box_max[1], box_max[2] };
+
+    for (int lane = 0; lane < n; lane++) {
+        if (!packet.is_active(lane)) {
+            continue;
+        }
+
+        const double o[3] = { packet.org_x[lane], packet.org_y[lane], packet.org_z[lane] };
+        const double d[3] = { packet.dir_x[lane], packet.dir_y[lane], packet.dir_z[lane] };
+        double t, k;
+        int axis;
+        if (slab(o, d, lo, hi, t_min, packet.t_max[lane], t, axis, k)) {
+            set_hit_record(packet.ray(lane), t, axis, k, recs[lane]);
+            packet.t_max[lane] = t;
+            hit_mask |= 1u << lane;
+        }
+    }
 }
 
-#endif
\ No newline at end of file
+#endif
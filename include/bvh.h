@@ -29,6 +29,13 @@ class BVHNode: public Hittable {
 
         virtual bool hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const override;
         virtual bool bounding_box(double time0, double time1, Aabb &output_box) const override;
+
+        virtual void children(std::vector<shared_ptr<Hittable>> &out) const override {
+            out.push_back(left);
+            if (right != left) {
+                out.push_back(right);
+            }
+        }
 };
 
 inline bool box_compare(
@@ -73,6 +80,8 @@ bool BVHNode::bounding_box(double time0, double time1, Aabb& output_box) const {
 }
 
 bool BVHNode::hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const {
+    RT_STAT_INC(bvh_nodes_visited);
+    RT_STAT_INC(aabb_tests);
     if (!box.hit(r, t_min, t_max)) {
         return false;
     }
@@ -3,6 +3,8 @@
 
 #include "rtweekend.h"
 
+#include "ray_packet.h"
+
 class Camera {
     private:
         Point3 origin;
@@ -50,6 +52,33 @@ class Camera {
 
             return Ray(origin + offset, lower_left_corner + s * horizontal + t * vertical - origin - offset, random_double2(time0, time1));
         }
+
+        /// @brief Generates up to N primary rays at once, e.g. all samples of
+        ///        one pixel. Lane k draws its lens and time samples from
+        ///        rngs[k], which is left where get_ray() would have left the
+        ///        thread generator, so the result matches N scalar calls.
+        /// @param s Horizontal image coordinate of each lane
+        /// @param t Vertical image coordinate of each lane
+        /// @param lanes How many lanes to fill
+        template <int N>
+        void get_ray_packet(
+            __F_IN__ const double s[N],
+            __F_IN__ const double t[N],
+            __F_IN__ int lanes,
+            __F_OUT__ RayPacket<N> &packet,
+            __F_INOUT__ Pcg32 rngs[N]
+        ) const {
+            auto saved = thread_rng();
+            packet.active = 0;
+
+            for (int k = 0; k < lanes; k++) {
+                thread_rng() = rngs[k];
+                packet.set(k, get_ray(s[k], t[k]), INF);
+                rngs[k] = thread_rng();
+            }
+
+            thread_rng() = saved;
+        }
 };
 
 #endif
\ No newline at end of file
@@ -24,6 +24,7 @@ class ConstantMedium : public Hittable {
 };
 
 bool ConstantMedium::hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const {
+    RT_STAT_INC(medium_tests);
     const bool enableDebug = false;
     const bool debugging = enableDebug && random_double2() < 0.00001;
 
@@ -69,7 +70,7 @@ bool ConstantMedium::hit(const Ray &r, double t_min, double t_max, HitRecord &re
 
     rec.normal = Vec3(1, 0, 0);
     rec.front_face = true;
-    rec.mat_ptr = phase_function;
+    rec.mat_ptr = phase_function.get();
 
     return true;
 }
@@ -0,0 +1,113 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include "rtweekend.h"
+
+#include "image.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/// @brief What a debug render shows instead of radiance.
+enum class DebugMode {
+    None,
+    Nodes,          ///< BVH nodes visited per camera path
+    Primitives,     ///< Primitive intersection tests per camera path
+    Depth,          ///< Rays traced per camera path
+    Samples         ///< Samples the progressive renderer spent on the pixel
+};
+
+/// @return false if `name` is not one of nodes, prims, depth or samples
+inline bool debug_mode_from_name(__F_IN__ const std::string &name, __F_OUT__ DebugMode &mode) {
+    if (name == "nodes") mode = DebugMode::Nodes;
+    else if (name == "prims") mode = DebugMode::Primitives;
+    else if (name == "depth") mode = DebugMode::Depth;
+    else if (name == "samples") mode = DebugMode::Samples;
+    else return false;
+    return true;
+}
+
+inline const char *debug_mode_name(DebugMode mode) {
+    switch (mode) {
+        case DebugMode::Nodes: return "BVH nodes visited";
+        case DebugMode::Primitives: return "primitive tests";
+        case DebugMode::Depth: return "rays per path";
+        case DebugMode::Samples: return "samples";
+        default: return "radiance";
+    }
+}
+
+/// @brief True for the modes that read the RT_ENABLE_STATS counters.
+inline bool debug_mode_needs_stats(DebugMode mode) {
+    return mode == DebugMode::Nodes || mode == DebugMode::Primitives || mode == DebugMode::Depth;
+}
+
+/// @brief The quantity a counting mode plots, from the counters of one
+///        pixel's paths.
+inline double heatmap_value(__F_IN__ const RenderStats &stats, __F_IN__ DebugMode mode) {
+    switch (mode) {
+        case DebugMode::Nodes: return static_cast<double>(stats.bvh_nodes_visited);
+        case DebugMode::Primitives: return static_cast<double>(stats.primitive_tests());
+        case DebugMode::Depth: return static_cast<double>(stats.rays_traced);
+        default: return 0.0;
+    }
+}
+
+/// @brief Maps [0, 1] onto a blue, cyan, green, yellow, red ramp.
+inline Color heatmap_color(double x) {
+    static const Color stops[] = {
+        Color(0.05, 0.05, 0.35), Color(0.0, 0.6, 0.9), Color(0.1, 0.8, 0.2), Color(0.95, 0.9, 0.1), Color(0.9, 0.1, 0.05)
+    };
+    const int last = static_cast<int>(sizeof(stops) / sizeof(stops[0])) - 1;
+
+    x = clamp(x, 0.0, 1.0) * last;
+    int k = std::min(static_cast<int>(x), last - 1);
+    double f = x - k;
+    return (1 - f) * stops[k] + f * stops[k + 1];
+}
+
+/// @brief Turns per-pixel values into a false-color image. The ramp spans
+///        zero to the 99th percentile, so a few extreme pixels cannot wash
+///        out the rest; anything above it saturates to red.
+/// @param values One value per pixel, row j = 0 at the bottom like the
+///        framebuffer
+inline Image heatmap_image(
+    __F_IN__ const std::vector<float> &values,
+    __F_IN__ int width,
+    __F_IN__ int height,
+    __F_IN__ DebugMode mode
+) {
+    std::vector<float> sorted(values);
+    float max_value = 0;
+    float top = 0;
+    double sum = 0;
+    if (!sorted.empty()) {
+        auto p99 = sorted.begin() + static_cast<std::ptrdiff_t>(0.99 * (sorted.size() - 1));
+        std::nth_element(sorted.begin(), p99, sorted.end());
+        top = *p99;
+        max_value = *std::max_element(values.begin(), values.end());
+        for (auto v : values) {
+            sum += v;
+        }
+    }
+    float scale = top > 0 ? 1.0f / top : 0.0f;
+
+    std::cerr << "Heatmap of " << debug_mode_name(mode) << ": mean " << (values.empty() ? 0.0 : sum / values.size())
+              << ", 99th percentile " << top << ", max " << max_value << '\n';
+
+    // Squared, because write_image() applies gamma 2 and the ramp is meant
+    // to be seen as is.
+    Image image(width, height);
+    for (int j = 0; j < height; j++) {
+        for (int i = 0; i < width; i++) {
+            Color c = heatmap_color(values[static_cast<size_t>(j) * width + i] * scale);
+            image.set(i, height - 1 - j, c * c);
+        }
+    }
+    return image;
+}
+
+#endif
@@ -4,13 +4,21 @@
 #include "rtweekend.h"
 
 #include "aabb.h"
+#include "ray_packet.h"
+
+#include <type_traits>
+#include <vector>
 
 class Material;
 
+/// @brief Where and how a ray hit a surface. Holds only plain values, so
+///        copying one (which every hit() does) never touches a refcount.
+///        The material is borrowed from the primitive that was hit, which
+///        keeps it alive through its own shared_ptr.
 struct HitRecord {
     Point3 p;
     Vec3 normal;
-    shared_ptr<Material> mat_ptr;
+    const Material *mat_ptr;
     double t;
     double u;
     double v;
@@ -20,6 +28,27 @@ struct HitRecord {
         front_face = dot(r.direction(), outward_normal) < 0;
         normal = front_face ? outward_normal : -outward_normal;
     }
+
+    /// @brief A ray leaving the hit point, started just off the surface so
+    ///        it can be traced from t_min 0.
+    inline Ray spawn_ray(const Vec3 &direction, double time) const {
+        return Ray(offset_ray_origin(p, normal, direction), direction, time);
+    }
+};
+
+static_assert(std::is_trivially_copyable<HitRecord>::value, "HitRecord must stay trivially copyable");
+
+/// @brief The concrete type of a primitive that a BVH can store by value
+///        and call without going through the vtable. Everything else is
+///        Other and is only reached through the virtual hit().
+enum class PrimitiveKind : uint8_t {
+    Other,
+    Sphere,
+    MovingSphere,
+    XYRect,
+    XZRect,
+    YZRect,
+    Box
 };
 
 class Hittable {
@@ -37,6 +66,46 @@ class Hittable {
             __F_OUT__ Aabb &output_box
         ) const = 0;
 
+        /// @brief Intersects every active lane of a packet. Lanes that hit
+        ///        something closer than their t_max get t_max, recs[k] and
+        ///        bit k of hit_mask updated. The default falls back to the
+        ///        scalar hit() one lane at a time, with the lane's own
+        ///        generator installed if the packet carries them.
+        virtual void hit_packet(
+            __F_INOUT__ RayPacket8 &packet,
+            __F_IN__ double t_min,
+            __F_OUT__ HitRecord recs[RayPacket8::size],
+            __F_INOUT__ uint32_t &hit_mask
+        ) const {
+            for (int k = 0; k < RayPacket8::size; k++) {
+                if (!packet.is_active(k)) {
+                    continue;
+                }
+
+                Pcg32 saved;
+                if (packet.rngs) {
+                    saved = thread_rng();
+                    thread_rng() = packet.rngs[k];
+                }
+                bool lane_hit = hit(packet.ray(k), t_min, packet.t_max[k], recs[k]);
+                if (packet.rngs) {
+                    packet.rngs[k] = thread_rng();
+                    thread_rng() = saved;
+                }
+
+                if (lane_hit) {
+                    packet.t_max[k] = recs[k].t;
+                    hit_mask |= 1u << k;
+                }
+            }
+        }
+
+        /// @brief Overridden only by final classes, so a kind other than
+        ///        Other names the exact type behind the pointer.
+        virtual PrimitiveKind kind() const {
+            return PrimitiveKind::Other;
+        }
+
         virtual double pdf_value(
             __F_IN__ const Point3 &o,
             __F_IN__ const Vec3 &v
@@ -49,310 +118,16 @@ class Hittable {
         ) const {
             return Vec3(1, 0, 0);
         }
-};
-
-class Translate : public Hittable {
-    public:
-        shared_ptr<Hittable> ptr;
-        Vec3 offset;
-
-    public:
-        Translate(shared_ptr<Hittable> p, const Vec3 &displacement) : ptr(p), offset(displacement) {}
-
-        virtual bool hit(
-            const Ray &r, double t_min, double t_max, HitRecord &rec
-        ) const override;
-
-        virtual bool bounding_box(
-            double time0, double time1, Aabb &output_box
-        ) const override;
-};
-
-bool Translate::hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const {
-    Ray moved_r(r.origin() - offset, r.direction(), r.time());
-    if (!ptr->hit(moved_r, t_min, t_max, rec)) {
-        return false;
-    }
-
-    rec.p += offset;
-    rec.set_face_normal(moved_r, rec.normal);
-
-    return true;
-}
-
-bool Translate::bounding_box(double time0, double time1, Aabb &output_box) const {
-    if (!ptr->bounding_box(time0, time1, output_box)) {
-        return false;
-    }
-
-    output_box = Aabb(
-        output_box.min() + offset,
-        output_box.max() + offset
-    );
-
-    return true;
-}
-
-class RotateX: public Hittable {
-    public:
-        shared_ptr<Hittable> ptr;
-        double sin_theta;
-        double cos_theta;
-        bool hasbox;
-        Aabb bbox;
-
-    public:
-        RotateX(shared_ptr<Hittable> p, double angle);
-
-        virtual bool hit(
-            const Ray &r, double t_min, double t_max, HitRecord &rec
-        ) const override;
-
-        virtual bool bounding_box(
-            double time0, double time1, Aabb &output_box
-        ) const override {
-            output_box = bbox;
-            return hasbox;
-        }
-};
-
-class RotateY: public Hittable {
-    public:
-        shared_ptr<Hittable> ptr;
-        double sin_theta;
-        double cos_theta;
-        bool hasbox;
-        Aabb bbox;
 
-    public:
-        RotateY(shared_ptr<Hittable> p, double angle);
-
-        virtual bool hit(
-            const Ray &r, double t_min, double t_max, HitRecord &rec
-        ) const override;
-
-        virtual bool bounding_box(
-            double time0, double time1, Aabb &output_box
-        ) const override {
-            output_box = bbox;
-            return hasbox;
-        }
+        /// @brief Appends the objects this one is made of, for walks over
+        ///        a scene such as collect_lights(). Only containers whose
+        ///        children are in world space report them: an Instance's
+        ///        prototype, say, is in its own object space.
+        virtual void children(
+            __F_OUT__ std::vector<shared_ptr<Hittable>> &out
+        ) const {}
 };
 
-class RotateZ: public Hittable {
-    public:
-        shared_ptr<Hittable> ptr;
-        double sin_theta;
-        double cos_theta;
-        bool hasbox;
-        Aabb bbox;
-
-    public:
-        RotateZ(shared_ptr<Hittable> p, double angle);
-
-        virtual bool hit(
-            const Ray &r, double t_min, double t_max, HitRecord &rec
-        ) const override;
-
-        virtual bool bounding_box(
-            double time0, double time1, Aabb &output_box
-        ) const override {
-            output_box = bbox;
-            return hasbox;
-        }
-};
-
-RotateX::RotateX(shared_ptr<Hittable> p, double angle): ptr(p) {
-    auto radians = degrees_to_radians(angle);
-    sin_theta = sin(radians);
-    cos_theta = cos(radians);
-    hasbox = ptr->bounding_box(0, 1, bbox);
-
-    Point3 min(INF, INF, INF);
-    Point3 max(-INF, -INF, -INF);
-
-    for (int i = 0; i < 2; i++) {
-        for (int j = 0; j < 2; j++) {
-            for (int k = 0; k < 2; k++) {
-                auto x = i * bbox.max().x() + (1 - i) * bbox.min().x();
-                auto y = j * bbox.max().y() + (1 - j) * bbox.min().y();
-                auto z = k * bbox.max().z() + (1 - k) * bbox.min().z();
-
-                auto newy = cos_theta * y - sin_theta * z;
-                auto newz = sin_theta * y + cos_theta * z;
-
-                Vec3 tester(newy, x, newz);
-
-                for (int c = 0; c < 3; c++) {
-                    min[c] = fmin(min[c], tester[c]);
-                    max[c] = fmax(max[c], tester[c]);
-                }
-            }
-        }
-    }
-
-    bbox = Aabb(min, max);
-}
-
-RotateY::RotateY(shared_ptr<Hittable> p, double angle): ptr(p) {
-    auto radians = degrees_to_radians(angle);
-    sin_theta = sin(radians);
-    cos_theta = cos(radians);
-    hasbox = ptr->bounding_box(0, 1, bbox);
-    
-    Point3 min(INF, INF, INF);
-    Point3 max(-INF, -INF, -INF);
-
-    for (int i = 0; i < 2; i++) {
-        for (int j = 0; j < 2; j++) {
-            for (int k = 0; k < 2; k++) {
-                auto x = i * bbox.max().x() + (1 - i) * bbox.min().x();
-                auto y = j * bbox.max().y() + (1 - j) * bbox.min().y();
-                auto z = k * bbox.max().z() + (1 - k) * bbox.min().z();
-
-                auto newx = cos_theta * x + sin_theta * z;
-                auto newz = -sin_theta * x + cos_theta * z;
-
-                Vec3 tester(newx, y, newz);
-
-                for (int c = 0; c < 3; c++) {
-                    min[c] = fmin(min[c], tester[c]);
-                    max[c] = fmax(max[c], tester[c]);
-                }
-            }
-        }
-    }
-
-    bbox = Aabb(min, max);
-}
-
-RotateZ::RotateZ(shared_ptr<Hittable> p, double angle): ptr(p) {
-    auto radians = degrees_to_radians(angle);
-    sin_theta = sin(radians);
-    cos_theta = cos(radians);
-    hasbox = ptr->bounding_box(0, 1, bbox);
-
-    Point3 min(INF, INF, INF);
-    Point3 max(-INF, -INF, -INF);
-
-    for (int i = 0; i < 2; i++) {
-        for (int j = 0; j < 2; j++) {
-            for (int k = 0; k < 2; k++) {
-                auto x = i * bbox.max().x() + (1 - i) * bbox.min().x();
-                auto y = j * bbox.max().y() + (1 - j) * bbox.min().y();
-                auto z = k * bbox.max().z() + (1 - k) * bbox.min().z();
-
-                auto newx = cos_theta * x - sin_theta * y;
-                auto newy = sin_theta * x + cos_theta * y;
-
-                Vec3 tester(newx, newy, z);
-
-                for (int c = 0; c < 3; c++) {
-                    min[c] = fmin(min[c], tester[c]);
-                    max[c] = fmax(max[c], tester[c]);
-                }
-            }
-        }
-    }
-
-    bbox = Aabb(min, max);
-}
-
-bool RotateX::hit(
-    const Ray &r, double t_min, double t_max, HitRecord &rec
-) const {
-    auto origin = r.origin();
-    auto direction = r.direction();
-
-    origin[1] = cos_theta * r.origin()[1] + sin_theta * r.origin()[2];
-    origin[2] = -sin_theta * r.origin()[1] + cos_theta * r.origin()[2];
-
-    direction[1] = cos_theta * r.direction()[1] + sin_theta * r.direction()[2];
-    direction[2] = -sin_theta * r.direction()[1] + cos_theta * r.direction()[2];
-
-    Ray rotated_r(origin, direction, r.time());
-
-    if (!ptr->hit(rotated_r, t_min, t_max, rec)) {
-        return false;
-    }
-
-    auto p = rec.p;
-    auto normal = rec.normal;
-
-    p[1] = cos_theta * rec.p[1] - sin_theta * rec.p[2];
-    p[2] = sin_theta * rec.p[1] + cos_theta * rec.p[2];
-
-    normal[1] = cos_theta * rec.normal[1] - sin_theta * rec.normal[2];
-    normal[2] = sin_theta * rec.normal[1] + cos_theta * rec.normal[2];
-
-    rec.p = p;
-    rec.set_face_normal(rotated_r, normal);
-
-    return true;
-}
-
-bool RotateY::hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const {
-    auto origin = r.origin();
-    auto direction = r.direction();
-
-    origin[0] = cos_theta * r.origin()[0] - sin_theta * r.origin()[2];
-    origin[2] = sin_theta * r.origin()[0] + cos_theta * r.origin()[2];
-
-    direction[0] = cos_theta * r.direction()[0] - sin_theta * r.direction()[2];
-    direction[2] = sin_theta * r.direction()[0] + cos_theta * r.direction()[2];
-
-    Ray rotated_r(origin, direction, r.time());
-
-    if (!ptr->hit(rotated_r, t_min, t_max, rec)) {
-        return false;
-    }
-
-    auto p = rec.p;
-    auto normal = rec.normal;
-
-    p[0] = cos_theta * rec.p[0] + sin_theta * rec.p[2];
-    p[2] = -sin_theta * rec.p[0] + cos_theta * rec.p[2];
-
-    normal[0] = cos_theta * rec.normal[0] + sin_theta * rec.normal[2];
-    normal[2] = -sin_theta * rec.normal[0] + cos_theta * rec.normal[2];
-
-    rec.p = p;
-    rec.set_face_normal(rotated_r, normal);
-
-    return true;
-}
-
-bool RotateZ::hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const {
-    auto origin = r.origin();
-    auto direction = r.direction();
-
-    origin[0] = cos_theta * r.origin()[0] + sin_theta * r.origin()[1];
-    origin[1] = -sin_theta * r.origin()[0] + cos_theta * r.origin()[1];
-
-    direction[0] = cos_theta * r.direction()[0] + sin_theta * r.direction()[1];
-    direction[1] = -sin_theta * r.direction()[0] + cos_theta * r.direction()[1];
-
-    Ray rotated_r(origin, direction, r.time());
-
-    if (!ptr->hit(rotated_r, t_min, t_max, rec)) {
-        return false;
-    }
-
-    auto p = rec.p;
-    auto normal = rec.normal;
-
-    p[0] = cos_theta * rec.p[0] - sin_theta * rec.p[1];
-    p[1] = sin_theta * rec.p[0] + cos_theta * rec.p[1];
-
-    normal[0] = cos_theta * rec.normal[0] - sin_theta * rec.normal[1];
-    normal[1] = sin_theta * rec.normal[0] + cos_theta * rec.normal[1];
-
-    rec.p = p;
-    rec.set_face_normal(rotated_r, normal);
-
-    return true;
-}
-
 class FlipFace : public Hittable {
     public:
         shared_ptr<Hittable> ptr;
@@ -374,6 +149,10 @@ class FlipFace : public Hittable {
         virtual bool bounding_box(double time0, double time1, Aabb &output_box) const override {
             return ptr->bounding_box(time0, time1, output_box);
         }
+
+        virtual void children(std::vector<shared_ptr<Hittable>> &out) const override {
+            out.push_back(ptr);
+        }
 };
 
 #endif
\ No newline at end of file
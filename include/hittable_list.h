@@ -25,6 +25,10 @@ class HittableList : public Hittable {
         virtual double pdf_value(const Point3 &o, const Vec3 &v) const override;
         virtual bool bounding_box(double time0, double time1, Aabb &bounding_box) const override;
         virtual Vec3 random(const Vec3 &o) const override;
+
+        virtual void children(std::vector<shared_ptr<Hittable>> &out) const override {
+            out.insert(out.end(), objects.begin(), objects.end());
+        }
 };
 
 double HittableList::pdf_value(const Point3 &o, const Vec3 &v) const {
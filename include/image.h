@@ -0,0 +1,250 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "rtweekend.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+/// @brief Linear RGB image in single precision, rows stored top to bottom.
+///        Encoders turn it into a complete file in memory, which is then
+///        written with a single call.
+class Image {
+    public:
+        int width;
+        int height;
+        std::vector<float> rgb;
+
+    public:
+        Image(int w, int h) : width(w), height(h), rgb(static_cast<size_t>(w) * h * 3, 0.0f) {}
+
+        /// @brief Sets a pixel; `row` counts from the top of the image.
+        void set(int i, int row, const Color &c) {
+            float *p = &rgb[(static_cast<size_t>(row) * width + i) * 3];
+            p[0] = static_cast<float>(c.x());
+            p[1] = static_cast<float>(c.y());
+            p[2] = static_cast<float>(c.z());
+        }
+
+        const float *pixel(int i, int row) const {
+            return &rgb[(static_cast<size_t>(row) * width + i) * 3];
+        }
+};
+
+enum class ImageFormat {
+    PPM,    ///< Binary PPM (P6), gamma 2
+    PFM,    ///< Portable float map, linear
+    PNG     ///< 8-bit RGB PNG, gamma 2
+};
+
+/// @brief Picks a format from a file extension; anything unknown is PPM.
+inline ImageFormat image_format_from_path(const std::string &path) {
+    auto dot = path.rfind('.');
+    std::string ext = dot == std::string::npos ? "" : path.substr(dot + 1);
+    for (auto &ch : ext) {
+        ch = static_cast<char>(tolower(ch));
+    }
+
+    if (ext == "pfm") {
+        return ImageFormat::PFM;
+    }
+    if (ext == "png") {
+        return ImageFormat::PNG;
+    }
+    return ImageFormat::PPM;
+}
+
+/// @brief Maps a linear value to the 8-bit display value write_color()
+///        produces: gamma 2, then [0, 1) scaled to [0, 255].
+inline uint8_t to_display_byte(float linear) {
+    return static_cast<uint8_t>(256 * clamp(sqrt(static_cast<double>(linear)), 0.0, 0.999));
+}
+
+inline void append_string(std::vector<uint8_t> &out, const std::string &s) {
+    out.insert(out.end(), s.begin(), s.end());
+}
+
+inline std::vector<uint8_t> encode_ppm(const Image &image) {
+    std::vector<uint8_t> out;
+    append_string(out, "P6\n" + std::to_string(image.width) + ' ' + std::to_string(image.height) + "\n255\n");
+
+    size_t header = out.size();
+    out.resize(header + image.rgb.size());
+    for (size_t k = 0; k < image.rgb.size(); k++) {
+        out[header + k] = to_display_byte(image.rgb[k]);
+    }
+    return out;
+}
+
+/// @brief PFM stores little-endian floats (signalled by the negative scale)
+///        with the bottom row first.
+inline std::vector<uint8_t> encode_pfm(const Image &image) {
+    std::vector<uint8_t> out;
+    append_string(out, "PF\n" + std::to_string(image.width) + ' ' + std::to_string(image.height) + "\n-1.0\n");
+
+    size_t row_bytes = static_cast<size_t>(image.width) * 3 * sizeof(float);
+    size_t header = out.size();
+    out.resize(header + row_bytes * image.height);
+
+    for (int row = 0; row < image.height; row++) {
+        uint8_t *dst = &out[header + row_bytes * (image.height - 1 - row)];
+        const float *src = image.pixel(0, row);
+        for (size_t k = 0; k < static_cast<size_t>(image.width) * 3; k++) {
+            uint32_t bits;
+            std::memcpy(&bits, &src[k], sizeof(bits));
+            dst[4 * k + 0] = static_cast<uint8_t>(bits);
+            dst[4 * k + 1] = static_cast<uint8_t>(bits >> 8);
+            dst[4 * k + 2] = static_cast<uint8_t>(bits >> 16);
+            dst[4 * k + 3] = static_cast<uint8_t>(bits >> 24);
+        }
+    }
+    return out;
+}
+
+inline uint32_t png_crc32(const uint8_t *data, size_t len) {
+    static const auto table = [] {
+        std::array<uint32_t, 256> t;
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            t[n] = c;
+        }
+        return t;
+    }();
+
+    uint32_t crc = 0xffffffffu;
+    for (size_t k = 0; k < len; k++) {
+        crc = table[(crc ^ data[k]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+inline uint32_t zlib_adler32(const uint8_t *data, size_t len) {
+    uint32_t a = 1, b = 0;
+    while (len > 0) {
+        // 5552 is the longest run that cannot overflow b before the modulo.
+        size_t run = std::min<size_t>(len, 5552);
+        for (size_t k = 0; k < run; k++) {
+            a += data[k];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += run;
+        len -= run;
+    }
+    return (b << 16) | a;
+}
+
+inline void append_u32_be(std::vector<uint8_t> &out, uint32_t v) {
+    out.push_back(static_cast<uint8_t>(v >> 24));
+    out.push_back(static_cast<uint8_t>(v >> 16));
+    out.push_back(static_cast<uint8_t>(v >> 8));
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+inline void append_png_chunk(std::vector<uint8_t> &out, const char *type, const std::vector<uint8_t> &data) {
+    append_u32_be(out, static_cast<uint32_t>(data.size()));
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    append_u32_be(out, png_crc32(&out[start], out.size() - start));
+}
+
+/// @brief Minimal PNG encoder: 8-bit RGB, every scanline filtered with Sub
+///        and wrapped in uncompressed (stored) deflate blocks. Files are about
+///        the size of the raw pixels, but it needs no zlib and any viewer
+///        reads them.
+inline std::vector<uint8_t> encode_png(const Image &image) {
+    // Filtered scanlines: a filter byte, then the row.
+    size_t row_bytes = static_cast<size_t>(image.width) * 3;
+    std::vector<uint8_t> raw((row_bytes + 1) * image.height);
+    for (int row = 0; row < image.height; row++) {
+        uint8_t *dst = &raw[(row_bytes + 1) * row];
+        const float *src = image.pixel(0, row);
+        dst[0] = 1;
+        uint8_t prev[3] = { 0, 0, 0 };
+        for (size_t k = 0; k < row_bytes; k++) {
+            uint8_t v = to_display_byte(src[k]);
+            dst[1 + k] = static_cast<uint8_t>(v - prev[k % 3]);
+            prev[k % 3] = v;
+        }
+    }
+
+    // zlib stream of stored blocks, each at most 65535 bytes.
+    std::vector<uint8_t> z = { 0x78, 0x01 };
+    size_t pos = 0;
+    do {
+        size_t len = std::min<size_t>(65535, raw.size() - pos);
+        bool last = pos + len == raw.size();
+        z.push_back(last ? 1 : 0);
+        z.push_back(static_cast<uint8_t>(len));
+        z.push_back(static_cast<uint8_t>(len >> 8));
+        z.push_back(static_cast<uint8_t>(~len));
+        z.push_back(static_cast<uint8_t>(~len >> 8));
+        z.insert(z.end(), raw.begin() + pos, raw.begin() + pos + len);
+        pos += len;
+    } while (pos < raw.size());
+
+    append_u32_be(z, zlib_adler32(raw.data(), raw.size()));
+
+    std::vector<uint8_t> ihdr;
+    append_u32_be(ihdr, static_cast<uint32_t>(image.width));
+    append_u32_be(ihdr, static_cast<uint32_t>(image.height));
+    ihdr.insert(ihdr.end(), { 8, 2, 0, 0, 0 });   // 8 bit, RGB, deflate, adaptive filters, no interlace
+
+    std::vector<uint8_t> out = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    append_png_chunk(out, "IHDR", ihdr);
+    append_png_chunk(out, "IDAT", z);
+    append_png_chunk(out, "IEND", {});
+    return out;
+}
+
+inline std::vector<uint8_t> encode_image(const Image &image, ImageFormat format) {
+    switch (format) {
+        case ImageFormat::PFM: return encode_pfm(image);
+        case ImageFormat::PNG: return encode_png(image);
+        default: return encode_ppm(image);
+    }
+}
+
+/// @brief Encodes an image and writes it with one fwrite.
+/// @param path Output file, or "-" for stdout
+/// @return false if the file could not be written
+inline bool write_image(const Image &image, ImageFormat format, const std::string &path) {
+    auto bytes = encode_image(image, format);
+
+    FILE *f = stdout;
+    if (path != "-") {
+        f = std::fopen(path.c_str(), "wb");
+        if (!f) {
+            return false;
+        }
+    } else {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    }
+
+    bool ok = std::fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+    ok = std::fflush(f) == 0 && ok;
+    if (f != stdout) {
+        ok = std::fclose(f) == 0 && ok;
+    }
+    return ok;
+}
+
+#endif
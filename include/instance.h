@@ -0,0 +1,104 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "transform.h"
+
+/// @brief A prototype placed in the world by an affine transform. The
+///        prototype, typically a BVH or a mesh, is shared: any number of
+///        instances of it cost one copy of its geometry, and a ray pays a
+///        single transform into object space however the placement was
+///        built up. Compose rotations and translations into one Transform
+///        when the scene is built rather than nesting instances.
+class Instance : public Hittable {
+    public:
+        shared_ptr<const Hittable> prototype;
+        Transform object_to_world;
+        Transform world_to_object;
+
+    public:
+        Instance(shared_ptr<const Hittable> prototype, const Transform &object_to_world);
+
+        virtual bool hit(
+            const Ray &r, double t_min, double t_max, HitRecord &rec
+        ) const override;
+
+        virtual void hit_packet(
+            RayPacket8 &packet, double t_min, HitRecord recs[RayPacket8::size], uint32_t &hit_mask
+        ) const override;
+
+        /// @brief The prototype's box over the caller's time range, taken
+        ///        to world space, so moving prototypes keep their whole sweep.
+        virtual bool bounding_box(
+            double time0, double time1, Aabb &output_box
+        ) const override;
+
+    private:
+        /// @brief Takes an object-space hit to world space. t needs nothing:
+        ///        the direction was transformed without being normalized,
+        ///        so it means the same in both spaces. So does front_face,
+        ///        as the normal goes through the inverse transpose.
+        void to_world(HitRecord &rec) const {
+            rec.p = object_to_world.point(rec.p);
+            rec.normal = normal(world_to_object.transpose_vector(rec.normal));
+        }
+};
+
+Instance::Instance(shared_ptr<const Hittable> prototype, const Transform &object_to_world)
+    : prototype(prototype), object_to_world(object_to_world), world_to_object(object_to_world.inverse()) {}
+
+bool Instance::bounding_box(double time0, double time1, Aabb &output_box) const {
+    if (!prototype->bounding_box(time0, time1, output_box)) {
+        return false;
+    }
+
+    output_box = object_to_world.bounds(output_box);
+    return true;
+}
+
+bool Instance::hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const {
+    Ray object_r(world_to_object.point(r.origin()), world_to_object.vector(r.direction()), r.time());
+    if (!prototype->hit(object_r, t_min, t_max, rec)) {
+        return false;
+    }
+
+    to_world(rec);
+    return true;
+}
+
+void Instance::hit_packet(RayPacket8 &packet, double t_min, HitRecord recs[RayPacket8::size], uint32_t &hit_mask) const {
+    const int n = RayPacket8::size;
+    const auto &w = world_to_object.m;
+
+    RayPacket8 object_packet;
+    object_packet.active = packet.active;
+    object_packet.rngs = packet.rngs;
+    for (int k = 0; k < n; k++) {
+        auto ox = packet.org_x[k], oy = packet.org_y[k], oz = packet.org_z[k];
+        auto dx = packet.dir_x[k], dy = packet.dir_y[k], dz = packet.dir_z[k];
+
+        object_packet.org_x[k] = w[0][0] * ox + w[0][1] * oy + w[0][2] * oz + w[0][3];
+        object_packet.org_y[k] = w[1][0] * ox + w[1][1] * oy + w[1][2] * oz + w[1][3];
+        object_packet.org_z[k] = w[2][0] * ox + w[2][1] * oy + w[2][2] * oz + w[2][3];
+        object_packet.dir_x[k] = w[0][0] * dx + w[0][1] * dy + w[0][2] * dz;
+        object_packet.dir_y[k] = w[1][0] * dx + w[1][1] * dy + w[1][2] * dz;
+        object_packet.dir_z[k] = w[2][0] * dx + w[2][1] * dy + w[2][2] * dz;
+        object_packet.time[k] = packet.time[k];
+        object_packet.t_max[k] = packet.t_max[k];
+    }
+
+    uint32_t object_mask = 0;
+    prototype->hit_packet(object_packet, t_min, recs, object_mask);
+
+    for (int k = 0; k < n; k++) {
+        if ((object_mask >> k) & 1u) {
+            to_world(recs[k]);
+            packet.t_max[k] = object_packet.t_max[k];
+        }
+    }
+    hit_mask |= object_mask;
+}
+
+#endif
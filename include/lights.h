@@ -0,0 +1,497 @@
+#ifndef LIGHTS_H
+#define LIGHTS_H
+
+#include "rtweekend.h"
+
+#include "aabb.h"
+#include "aarect.h"
+#include "alias_table.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "linear_bvh.h"
+#include "material.h"
+#include "pdf.h"
+#include "sphere.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+/// @brief The material of a shape that can be sampled as a light, one
+///        with pdf_value() and random(), or nullptr for any other object.
+inline const Material *light_material(__F_IN__ const Hittable &object) {
+    switch (object.kind()) {
+        case PrimitiveKind::Sphere:
+            return static_cast<const Sphere &>(object).mat_ptr.get();
+        case PrimitiveKind::XYRect:
+            return static_cast<const XYRect &>(object).mp.get();
+        case PrimitiveKind::XZRect:
+            return static_cast<const XZRect &>(object).mp.get();
+        case PrimitiveKind::YZRect:
+            return static_cast<const YZRect &>(object).mp.get();
+        default:
+            return nullptr;
+    }
+}
+
+/// @brief Finds the spheres and rects with an emissive material anywhere
+///        in `world`, looking inside lists, BVHs and flipped faces, and
+///        adds them to `lights` for next event estimation. Emitters of
+///        other shapes, or inside an Instance, are not found; paths still
+///        pick up their light when they hit them.
+/// @return The number of lights added
+inline size_t collect_lights(__F_IN__ const HittableList &world, __F_INOUT__ HittableList &lights) {
+    size_t found = 0;
+    std::vector<shared_ptr<Hittable>> pending(world.objects.rbegin(), world.objects.rend());
+
+    while (!pending.empty()) {
+        auto object = pending.back();
+        pending.pop_back();
+
+        const auto *mat = light_material(*object);
+        if (mat && mat->is_emissive()) {
+            lights.add(object);
+            found++;
+            continue;
+        }
+
+        // Children go on in reverse, so lights come out in scene order.
+        auto first = pending.size();
+        object->children(pending);
+        std::reverse(pending.begin() + first, pending.end());
+    }
+
+    return found;
+}
+
+/// @brief Estimated power of a light found by collect_lights(): the
+///        luminance it emits at its centre times its area. Textured lights
+///        are only approximated, which affects variance, not correctness.
+inline double light_power(__F_IN__ const Hittable &light) {
+    const Material *mat = light_material(light);
+    if (!mat) {
+        return 0;
+    }
+
+    double area = 0;
+    Point3 centre;
+    switch (light.kind()) {
+        case PrimitiveKind::Sphere: {
+            const auto &s = static_cast<const Sphere &>(light);
+            area = 4 * PI * s.radius * s.radius;
+            centre = s.center;
+            break;
+        }
+        case PrimitiveKind::XYRect: {
+            const auto &r = static_cast<const XYRect &>(light);
+            area = (r.x1 - r.x0) * (r.y1 - r.y0);
+            centre = Point3(0.5 * (r.x0 + r.x1), 0.5 * (r.y0 + r.y1), r.k);
+            break;
+        }
+        case PrimitiveKind::XZRect: {
+            const auto &r = static_cast<const XZRect &>(light);
+            area = (r.x1 - r.x0) * (r.z1 - r.z0);
+            centre = Point3(0.5 * (r.x0 + r.x1), r.k, 0.5 * (r.z0 + r.z1));
+            break;
+        }
+        case PrimitiveKind::YZRect: {
+            const auto &r = static_cast<const YZRect &>(light);
+            area = (r.y1 - r.y0) * (r.z1 - r.z0);
+            centre = Point3(r.k, 0.5 * (r.y0 + r.y1), 0.5 * (r.z0 + r.z1));
+            break;
+        }
+        default:
+            return 0;
+    }
+
+    HitRecord rec;
+    rec.p = centre;
+    rec.u = rec.v = 0.5;
+    rec.front_face = true;
+    auto c = mat->emitted(Ray(centre, Vec3(0, 1, 0)), rec, rec.u, rec.v, centre);
+    return (0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z()) * area;
+}
+
+/// @brief How LightSampler picks the light a shadow ray aims at.
+enum class LightSelection {
+    Uniform,    ///< Every light equally often
+    Power,      ///< In proportion to power, from an alias table
+    Bvh         ///< Power over squared distance, down a BVH of the lights
+};
+
+/// @return false if `name` is not uniform, power or bvh
+inline bool light_selection_from_name(__F_IN__ const std::string &name, __F_OUT__ LightSelection &selection) {
+    if (name == "uniform") {
+        selection = LightSelection::Uniform;
+    } else if (name == "power") {
+        selection = LightSelection::Power;
+    } else if (name == "bvh") {
+        selection = LightSelection::Bvh;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/// @brief The --light-sampling name of `selection`.
+inline const char *light_selection_name(LightSelection selection) {
+    switch (selection) {
+        case LightSelection::Uniform: return "uniform";
+        case LightSelection::Power: return "power";
+        default: return "bvh";
+    }
+}
+
+/// @brief Picks one of a scene's lights for a shadow ray and evaluates the
+///        density of the directions that results in. Built once per render
+///        over the lights collect_lights() found.
+///
+///        The lights sit in a BVH with one light per leaf and each node's
+///        total power beside it. Picking walks down from the root, choosing
+///        each child with probability proportional to its power over the
+///        squared distance to its box; the probability of a given light is
+///        the product of the choices on the path back up from its leaf.
+///        pdf_value() traces the direction through the same BVH, so only
+///        the few lights it could hit are asked for their density. Both are
+///        O(log n) in the number of lights, against O(n) for a HittableList.
+class LightSampler {
+    public:
+        std::vector<shared_ptr<Hittable>> lights;   ///< In BVH leaf order
+        LightSelection selection;
+        BVHBuildStats build_stats;
+
+    private:
+        std::vector<double> power;
+        std::vector<Aabb> boxes;
+        AliasTable power_table;
+
+        std::vector<LinearBVHNode> nodes;
+        std::vector<double> node_power;
+        std::vector<uint32_t> parent;       ///< Of every node but the root
+        std::vector<uint32_t> leaf_of;      ///< Of every light
+
+    public:
+        LightSampler(
+            __F_IN__ const HittableList &light_list,
+            __F_IN__ LightSelection selection = LightSelection::Bvh
+        );
+
+        bool empty() const { return lights.empty(); }
+
+        /// @brief Direction from `o` towards a point on one light.
+        Vec3 random(__F_IN__ const Point3 &o) const;
+
+        /// @brief Density, over directions from `o`, of random(o) returning
+        ///        `v`, summed over every light the line through it meets.
+        double pdf_value(__F_IN__ const Point3 &o, __F_IN__ const Vec3 &v) const;
+
+        /// @brief Probability that random(p) aims at light `i`.
+        double pmf(__F_IN__ const Point3 &p, __F_IN__ size_t i) const;
+
+    private:
+        size_t pick(const Point3 &p, double u) const;
+        static double importance(const Point3 &p, const Aabb &box, double power);
+        double node_importance(const Point3 &p, uint32_t node) const;
+};
+
+LightSampler::LightSampler(const HittableList &light_list, LightSelection selection) : selection(selection) {
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    std::vector<Aabb> light_boxes(light_list.objects.size());
+    for (size_t i = 0; i < light_list.objects.size(); i++) {
+        light_list.objects[i]->bounding_box(0, 1, light_boxes[i]);
+    }
+
+    // Lights that emit nothing are never picked, unless none emit at all.
+    BVHBuilder builder(light_boxes, 1, 1);
+    nodes = std::move(builder.nodes);
+
+    double total = 0;
+    for (auto index : builder.order) {
+        lights.push_back(light_list.objects[index]);
+        boxes.push_back(light_boxes[index]);
+        power.push_back(light_power(*light_list.objects[index]));
+        total += power.back();
+    }
+    if (total <= 0) {
+        std::fill(power.begin(), power.end(), 1.0);
+    }
+    power_table = AliasTable(power);
+
+    // Nodes are stored depth first, so children always follow their parent.
+    node_power.assign(nodes.size(), 0);
+    parent.assign(nodes.size(), 0);
+    leaf_of.assign(lights.size(), 0);
+    for (size_t n = nodes.size(); n-- > 0;) {
+        const auto &node = nodes[n];
+        if (node.is_leaf()) {
+            for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                node_power[n] += power[i];
+                leaf_of[i] = static_cast<uint32_t>(n);
+            }
+        } else {
+            node_power[n] = node_power[n + 1] + node_power[node.offset];
+            parent[n + 1] = parent[node.offset] = static_cast<uint32_t>(n);
+        }
+    }
+
+    auto end_time = std::chrono::high_resolution_clock::now();
+    build_stats = builder.stats;
+    build_stats.build_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+}
+
+double LightSampler::importance(const Point3 &p, const Aabb &box, double power) {
+    // Distance to the centre, but never closer than half the diagonal, so
+    // a point inside or beside a big node does not blow up.
+    auto centre = 0.5 * (box.min() + box.max());
+    auto d2 = std::max<double>((centre - p).length_squared(), 0.25 * (box.max() - box.min()).length_squared());
+    return d2 > 0 ? power / d2 : power;
+}
+
+double LightSampler::node_importance(const Point3 &p, uint32_t node) const {
+    const auto &n = nodes[node];
+    Aabb box(
+        Point3(n.bounds_min[0], n.bounds_min[1], n.bounds_min[2]),
+        Point3(n.bounds_max[0], n.bounds_max[1], n.bounds_max[2])
+    );
+    return importance(p, box, node_power[node]);
+}
+
+size_t LightSampler::pick(const Point3 &p, double u) const {
+    switch (selection) {
+        case LightSelection::Uniform:
+            return std::min(static_cast<size_t>(u * lights.size()), lights.size() - 1);
+        case LightSelection::Power:
+            return power_table.sample(u);
+        default:
+            break;
+    }
+
+    // Down the tree, reusing what is left of u at each choice.
+    uint32_t current = 0;
+    while (!nodes[current].is_leaf()) {
+        auto first = current + 1;
+        auto second = nodes[current].offset;
+        auto a = node_importance(p, first);
+        auto b = node_importance(p, second);
+        auto p_first = a + b > 0 ? a / (a + b) : 0.5;
+
+        if (u < p_first) {
+            u = u / p_first;
+            current = first;
+        } else {
+            u = (u - p_first) / (1 - p_first);
+            current = second;
+        }
+        u = std::min(u, 1 - std::numeric_limits<double>::epsilon());
+    }
+
+    const auto &leaf = nodes[current];
+    double sum = 0;
+    for (uint32_t i = leaf.offset; i < leaf.offset + leaf.count; i++) {
+        sum += importance(p, boxes[i], power[i]);
+    }
+    double target = u * sum;
+    for (uint32_t i = leaf.offset; i + 1 < leaf.offset + leaf.count; i++) {
+        target -= importance(p, boxes[i], power[i]);
+        if (target < 0) {
+            return i;
+        }
+    }
+    return leaf.offset + leaf.count - 1;
+}
+
+double LightSampler::pmf(const Point3 &p, size_t i) const {
+    switch (selection) {
+        case LightSelection::Uniform:
+            return 1.0 / lights.size();
+        case LightSelection::Power:
+            return power_table.pmf(i);
+        default:
+            break;
+    }
+
+    // Leaves usually hold one light, but coincident ones can share.
+    auto node = leaf_of[i];
+    const auto &leaf = nodes[node];
+    double prob = 1;
+    if (leaf.count > 1) {
+        double sum = 0;
+        for (uint32_t k = leaf.offset; k < leaf.offset + leaf.count; k++) {
+            sum += importance(p, boxes[k], power[k]);
+        }
+        prob = sum > 0 ? importance(p, boxes[i], power[i]) / sum : 1.0 / leaf.count;
+    }
+
+    while (node != 0) {
+        auto up = parent[node];
+        auto sibling = node == up + 1 ? nodes[up].offset : up + 1;
+        auto a = node_importance(p, node);
+        auto b = node_importance(p, sibling);
+        // Matches pick(): an all-dark pair splits evenly.
+        if (a + b > 0) {
+            prob *= a / (a + b);
+        } else {
+            prob *= 0.5;
+        }
+        node = up;
+    }
+    return prob;
+}
+
+Vec3 LightSampler::random(const Point3 &o) const {
+    return lights[pick(o, random_double2())]->random(o);
+}
+
+double LightSampler::pdf_value(const Point3 &o, const Vec3 &v) const {
+    if (nodes.empty()) {
+        return 0;
+    }
+
+    Vec3 inv_dir(1.0 / v.x(), 1.0 / v.y(), 1.0 / v.z());
+    bool dir_is_neg[3] = { inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0 };
+
+    double sum = 0;
+    uint32_t stack[128];
+    int stack_size = 0;
+    uint32_t current = 0;
+
+    while (true) {
+        const auto &node = nodes[current];
+
+        auto t0 = 0.0;
+        auto t1 = INF;
+        for (int a = 0; a < 3 && t0 <= t1; a++) {
+            auto near = ((dir_is_neg[a] ? node.bounds_max[a] : node.bounds_min[a]) - o[a]) * inv_dir[a];
+            auto far = ((dir_is_neg[a] ? node.bounds_min[a] : node.bounds_max[a]) - o[a]) * inv_dir[a];
+            t0 = near > t0 ? near : t0;
+            t1 = far < t1 ? far : t1;
+        }
+
+        if (t0 <= t1) {
+            if (node.is_leaf()) {
+                for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                    auto density = lights[i]->pdf_value(o, v);
+                    if (density > 0) {
+                        sum += pmf(o, i) * density;
+                    }
+                }
+            } else {
+                stack[stack_size++] = node.offset;
+                current = current + 1;
+                continue;
+            }
+        }
+
+        if (stack_size == 0) {
+            break;
+        }
+        current = stack[--stack_size];
+    }
+
+    return sum;
+}
+
+/// @brief Samples directions towards the lights of a LightSampler. Like
+///        HittablePdf it does not own its target and lives for one bounce.
+class LightPdf : public Pdf {
+    public:
+        Point3 o;
+        const LightSampler *sampler;
+
+    public:
+        LightPdf(
+            __F_IN__ const Point3 &origin,
+            __F_IN__ const LightSampler &s
+        ) : o(origin), sampler(&s) {}
+
+        virtual double value(
+            __F_IN__ const Vec3 &direction
+        ) const override {
+            RT_STAT_INC(pdf_evaluations);
+            return sampler->pdf_value(o, direction);
+        }
+
+        virtual Vec3 generate() const override {
+            return sampler->random(o);
+        }
+};
+
+/// @brief The two samples taken at a diffuse bounce: the continuation
+///        drawn from the material, and a shadow ray towards the lights.
+///        Each carries its multiple importance sampling weight against the
+///        other strategy, so both can be kept without double counting.
+struct BounceSamples {
+    Ray scattered;              ///< The path continues along this ray
+    Color scattered_factor;     ///< Throughput multiplier for `scattered`
+    double emission_weight = 1; ///< Weight of light that `scattered` hits
+
+    bool has_shadow_ray = false;
+    Ray shadow_ray;
+    Color shadow_factor;        ///< Multiplies the light `shadow_ray` finds
+};
+
+/// @brief Samples a diffuse bounce at `rec`: first a direction from the
+///        material's PDF, then one from the lights, in that order so every
+///        integrator draws the same random numbers. Emitters the scattered
+///        ray hits and those the shadow ray finds are both weighted by the
+///        power heuristic. Without lights the material's sample gets all
+///        the weight and no shadow ray is made.
+inline BounceSamples sample_bounce(
+    __F_IN__ const Ray &r,
+    __F_IN__ const HitRecord &rec,
+    __F_IN__ const ScatterRecord &srec,
+    __F_IN__ const LightSampler &lights
+) {
+    BounceSamples bounce;
+    const Pdf &bsdf = *srec.pdf();
+
+    bounce.scattered = rec.spawn_ray(bsdf.generate(), r.time());
+    auto bsdf_pdf = bsdf.value(bounce.scattered.direction());
+    if (bsdf_pdf > 0) {
+        bounce.scattered_factor = srec.attenuation * rec.mat_ptr->scattering_pdf(r, rec, bounce.scattered) / bsdf_pdf;
+    }
+
+    if (lights.empty()) {
+        return bounce;
+    }
+
+    LightPdf light_pdf(rec.p, lights);
+    if (bsdf_pdf > 0) {
+        bounce.emission_weight = power_heuristic(bsdf_pdf, light_pdf.value(bounce.scattered.direction()));
+    }
+
+    Ray shadow = rec.spawn_ray(light_pdf.generate(), r.time());
+    auto shadow_pdf = light_pdf.value(shadow.direction());
+    auto f = rec.mat_ptr->scattering_pdf(r, rec, shadow);
+    if (shadow_pdf > 0 && f > 0) {
+        bounce.has_shadow_ray = true;
+        bounce.shadow_ray = shadow;
+        bounce.shadow_factor = srec.attenuation * f
+                             * power_heuristic(shadow_pdf, bsdf.value(shadow.direction())) / shadow_pdf;
+    }
+
+    return bounce;
+}
+
+/// @brief Light arriving along a shadow ray: the emission of whatever it
+///        hits first, so an occluder, or the back of a one-sided light,
+///        gives black.
+inline Color emission_along(__F_IN__ const Hittable &world, __F_IN__ const Ray &shadow_ray) {
+    RT_STAT_INC(shadow_rays);
+    HitRecord rec;
+    bool hit;
+    {
+        RT_STAT_TIMER(intersect_ns);
+        hit = world.hit(shadow_ray, 0, INF, rec);
+    }
+    if (!hit) {
+        return Color(0, 0, 0);
+    }
+    return rec.mat_ptr->emitted(shadow_ray, rec, rec.u, rec.v, rec.p);
+}
+
+#endif
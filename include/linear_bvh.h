@@ -0,0 +1,566 @@
+#ifndef LINEAR_BVH_H
+#define LINEAR_BVH_H
+
+#include "rtweekend.h"
+
+#include "aabb.h"
+#include "hittable.h"
+#include "hittable_list.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// @brief One node of a flattened BVH, packed into 32 bytes.
+///        Interior nodes store their first child right after themselves and
+///        the index of the second child in `offset`. Leaves store the first
+///        entry of their primitive range in `offset` and its length in `count`.
+struct LinearBVHNode {
+    float bounds_min[3];
+    float bounds_max[3];
+    uint32_t offset;
+    uint16_t count;
+    uint8_t axis;
+    uint8_t pad;
+
+    bool is_leaf() const { return count > 0; }
+};
+
+static_assert(sizeof(LinearBVHNode) == 32, "LinearBVHNode must stay 32 bytes");
+
+/// @brief Numbers describing one BVH build, printed at scene setup.
+struct BVHBuildStats {
+    double build_ms = 0;
+    size_t primitive_count = 0;
+    size_t node_count = 0;
+    size_t leaf_count = 0;
+    int max_depth = 0;
+    int threads = 1;
+};
+
+inline std::ostream& operator<<(std::ostream &out, const BVHBuildStats &stats) {
+    return out << stats.primitive_count << " primitives, "
+               << stats.node_count << " nodes (" << stats.leaf_count << " leaves, depth " << stats.max_depth << "), "
+               << stats.build_ms << "ms on " << stats.threads << " thread(s)";
+}
+
+/// @brief Stats of a BVH nested inside a scene, such as a ground made of
+///        boxes, under the name it is reported by.
+struct NamedBVHStats {
+    std::string name;
+    BVHBuildStats stats;
+};
+
+/// @brief Builds a flattened BVH over a set of bounding boxes using binned
+///        SAH. Only the boxes are looked at, so the same builder serves
+///        any kind of primitive; the caller reorders its primitives with
+///        `order` afterwards.
+///
+///        Large builds run in parallel: the bounds and bins of big ranges
+///        are computed in chunks on several threads, and once a range is
+///        split its two halves are built as independent tasks into their
+///        own node arrays, which are spliced together afterwards. Every task
+///        works on a disjoint slice of the one shared `order` array. Chunk
+///        helpers and subtree tasks draw on one budget of spare threads, so
+///        a build never runs more than `threads` at once.
+class BVHBuilder {
+    public:
+        static const int bin_count = 16;
+        static constexpr double traversal_cost = 1.0;
+        /// Past this depth splits fall back to the median, which keeps the
+        /// tree shallow enough for the fixed traversal stack.
+        static const int max_sah_depth = 64;
+        /// Ranges smaller than this are not worth a thread of their own.
+        static const size_t parallel_task_threshold = 4096;
+        /// Ranges at least this large get their bounds and bins in chunks.
+        static const size_t parallel_chunk_threshold = 1 << 16;
+
+        std::vector<LinearBVHNode> nodes;
+        std::vector<uint32_t> order;
+        BVHBuildStats stats;
+
+    private:
+        std::vector<Aabb> boxes;
+        std::vector<Point3> centroids;
+        int max_leaf_size;
+        double intersect_cost;
+        int thread_count;
+        mutable std::atomic<int> spare_threads;
+
+    public:
+        /// @param primitive_boxes Bounding box of every primitive
+        /// @param max_prims_in_leaf Largest leaf SAH may choose to keep
+        /// @param threads Threads to build with, 0 for one per core
+        /// @param primitive_cost Cost of intersecting one primitive against
+        ///        that of visiting a node; the cheaper primitives are, the
+        ///        larger the leaves SAH keeps
+        BVHBuilder(
+            __F_IN__ std::vector<Aabb> primitive_boxes,
+            __F_IN__ int max_prims_in_leaf = 4,
+            __F_IN__ int threads = 0,
+            __F_IN__ double primitive_cost = 1.0
+        );
+
+    private:
+        struct Bin {
+            Aabb box;
+            int count = 0;
+        };
+
+        struct RangeInfo {
+            Aabb box;
+            Aabb centroid_box;
+            bool empty = true;
+
+            void add(const Aabb &b, const Point3 &c) {
+                box = empty ? b : surrounding_box(box, b);
+                centroid_box = empty ? Aabb(c, c) : surrounding_box(centroid_box, Aabb(c, c));
+                empty = false;
+            }
+
+            void merge(const RangeInfo &other) {
+                if (other.empty) return;
+                box = empty ? other.box : surrounding_box(box, other.box);
+                centroid_box = empty ? other.centroid_box : surrounding_box(centroid_box, other.centroid_box);
+                empty = false;
+            }
+        };
+
+        /// @brief Calls fn(chunk_start, chunk_end, chunk) on up to `chunks`
+        ///        slices of [start, end), on as many threads as the budget
+        ///        has spare; chunk indices run from 0 and may stop short.
+        template <typename F>
+        void for_each_chunk(size_t start, size_t end, int chunks, F &&fn) const;
+
+        /// @brief Takes up to `wanted` threads from the spare budget.
+        /// @return How many were taken; give them back with release_threads()
+        int reserve_threads(int wanted) const;
+        void release_threads(int count) const { spare_threads.fetch_add(count); }
+
+        RangeInfo range_info(size_t start, size_t end) const;
+        uint32_t build_recursive(std::vector<LinearBVHNode> &out, size_t start, size_t end, int depth);
+        void set_bounds(LinearBVHNode &node, const Aabb &box) const;
+        uint32_t make_leaf(std::vector<LinearBVHNode> &out, size_t start, size_t end, const Aabb &box) const;
+        void collect_stats();
+};
+
+inline double surface_area(const Aabb &box) {
+    auto d = box.max() - box.min();
+    return 2 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+}
+
+BVHBuilder::BVHBuilder(std::vector<Aabb> primitive_boxes, int max_prims_in_leaf, int threads, double primitive_cost)
+    : boxes(std::move(primitive_boxes)), max_leaf_size(std::max(1, std::min(max_prims_in_leaf, 255))),
+      intersect_cost(primitive_cost) {
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    thread_count = threads > 0 ? threads : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    spare_threads = thread_count - 1;
+
+    order.resize(boxes.size());
+    centroids.resize(boxes.size());
+
+    for_each_chunk(0, boxes.size(), thread_count, [&](size_t chunk_start, size_t chunk_end, int) {
+        for (size_t i = chunk_start; i < chunk_end; i++) {
+            order[i] = static_cast<uint32_t>(i);
+            centroids[i] = 0.5 * (boxes[i].min() + boxes[i].max());
+        }
+    });
+
+    if (!boxes.empty()) {
+        nodes.reserve(2 * boxes.size());
+        build_recursive(nodes, 0, boxes.size(), 0);
+    }
+
+    auto end_time = std::chrono::high_resolution_clock::now();
+    stats.build_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+    stats.threads = thread_count;
+    collect_stats();
+}
+
+int BVHBuilder::reserve_threads(int wanted) const {
+    int spare = spare_threads.load();
+    while (spare > 0) {
+        int taken = std::min(spare, wanted);
+        if (spare_threads.compare_exchange_weak(spare, spare - taken)) {
+            return taken;
+        }
+    }
+    return 0;
+}
+
+template <typename F>
+void BVHBuilder::for_each_chunk(size_t start, size_t end, int chunks, F &&fn) const {
+    size_t span = end - start;
+    int helpers = chunks > 1 && span >= parallel_chunk_threshold ? reserve_threads(chunks - 1) : 0;
+    if (helpers == 0) {
+        fn(start, end, 0);
+        return;
+    }
+    chunks = helpers + 1;
+
+    std::vector<std::thread> workers;
+    for (int c = 1; c < chunks; c++) {
+        workers.emplace_back(fn, start + span * c / chunks, start + span * (c + 1) / chunks, c);
+    }
+    fn(start, start + span / chunks, 0);
+
+    for (auto &w : workers) {
+        w.join();
+    }
+    release_threads(helpers);
+}
+
+BVHBuilder::RangeInfo BVHBuilder::range_info(size_t start, size_t end) const {
+    int chunks = end - start >= parallel_chunk_threshold ? thread_count : 1;
+    std::vector<RangeInfo> partial(chunks);
+
+    for_each_chunk(start, end, chunks, [&](size_t chunk_start, size_t chunk_end, int chunk) {
+        for (size_t i = chunk_start; i < chunk_end; i++) {
+            partial[chunk].add(boxes[order[i]], centroids[order[i]]);
+        }
+    });
+
+    for (int c = 1; c < chunks; c++) {
+        partial[0].merge(partial[c]);
+    }
+
+    return partial[0];
+}
+
+void BVHBuilder::set_bounds(LinearBVHNode &node, const Aabb &box) const {
+    // Round outwards so the float box never shrinks below the double one.
+    for (int a = 0; a < 3; a++) {
+        node.bounds_min[a] = std::nextafter(static_cast<float>(box.min()[a]), -std::numeric_limits<float>::infinity());
+        node.bounds_max[a] = std::nextafter(static_cast<float>(box.max()[a]), std::numeric_limits<float>::infinity());
+    }
+}
+
+uint32_t BVHBuilder::make_leaf(std::vector<LinearBVHNode> &out, size_t start, size_t end, const Aabb &box) const {
+    auto index = static_cast<uint32_t>(out.size());
+    out.emplace_back();
+
+    auto &node = out.back();
+    set_bounds(node, box);
+    node.offset = static_cast<uint32_t>(start);
+    node.count = static_cast<uint16_t>(end - start);
+    node.axis = 0;
+    node.pad = 0;
+
+    return index;
+}
+
+uint32_t BVHBuilder::build_recursive(std::vector<LinearBVHNode> &out, size_t start, size_t end, int depth) {
+    auto info = range_info(start, end);
+    const auto &box = info.box;
+    const auto &centroid_box = info.centroid_box;
+
+    size_t span = end - start;
+    if (span == 1) {
+        return make_leaf(out, start, end, box);
+    }
+
+    auto extent = centroid_box.max() - centroid_box.min();
+    int axis = 0;
+    if (extent.y() > extent[axis]) axis = 1;
+    if (extent.z() > extent[axis]) axis = 2;
+
+    size_t mid;
+
+    if (extent[axis] <= 0) {
+        // Every centroid is in the same spot, no plane can separate them.
+        if (static_cast<int>(span) <= max_leaf_size) {
+            return make_leaf(out, start, end, box);
+        }
+        mid = start + span / 2;
+    } else {
+        auto axis_min = centroid_box.min()[axis];
+        auto scale = bin_count / extent[axis];
+
+        auto bin_of = [&](uint32_t prim) {
+            int b = static_cast<int>((centroids[prim][axis] - axis_min) * scale);
+            return std::min(b, bin_count - 1);
+        };
+
+        int chunks = span >= parallel_chunk_threshold ? thread_count : 1;
+        std::vector<std::array<Bin, bin_count>> partial_bins(chunks);
+
+        for_each_chunk(start, end, chunks, [&](size_t chunk_start, size_t chunk_end, int chunk) {
+            auto &chunk_bins = partial_bins[chunk];
+            for (size_t i = chunk_start; i < chunk_end; i++) {
+                auto &bin = chunk_bins[bin_of(order[i])];
+                bin.box = bin.count == 0 ? boxes[order[i]] : surrounding_box(bin.box, boxes[order[i]]);
+                bin.count++;
+            }
+        });
+
+        auto &bins = partial_bins[0];
+        for (int c = 1; c < chunks; c++) {
+            for (int b = 0; b < bin_count; b++) {
+                const auto &other = partial_bins[c][b];
+                if (other.count == 0) continue;
+                bins[b].box = bins[b].count == 0 ? other.box : surrounding_box(bins[b].box, other.box);
+                bins[b].count += other.count;
+            }
+        }
+
+        // Sweep from the right to get the area and count of every suffix,
+        // then from the left to evaluate each of the bin_count - 1 planes.
+        double right_area[bin_count];
+        int right_count[bin_count];
+        Aabb acc;
+        int count = 0;
+
+        for (int b = bin_count - 1; b > 0; b--) {
+            if (bins[b].count > 0) {
+                acc = count == 0 ? bins[b].box : surrounding_box(acc, bins[b].box);
+                count += bins[b].count;
+            }
+            right_area[b] = count > 0 ? surface_area(acc) : 0;
+            right_count[b] = count;
+        }
+
+        double best_cost = INF;
+        int best_split = -1;
+        count = 0;
+
+        for (int b = 0; b < bin_count - 1; b++) {
+            if (bins[b].count > 0) {
+                acc = count == 0 ? bins[b].box : surrounding_box(acc, bins[b].box);
+                count += bins[b].count;
+            }
+            if (count == 0 || right_count[b + 1] == 0) {
+                continue;
+            }
+
+            auto cost = count * surface_area(acc) + right_count[b + 1] * right_area[b + 1];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_split = b;
+            }
+        }
+
+        auto parent_area = surface_area(box);
+        auto split_cost = traversal_cost + intersect_cost * best_cost / parent_area;
+        auto leaf_cost = intersect_cost * span;
+
+        if (best_split < 0 || depth >= max_sah_depth
+            || (static_cast<int>(span) <= max_leaf_size && leaf_cost <= split_cost)) {
+            if (static_cast<int>(span) <= max_leaf_size) {
+                return make_leaf(out, start, end, box);
+            }
+            mid = start + span / 2;
+            std::nth_element(order.begin() + start, order.begin() + mid, order.begin() + end,
+                [&](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+        } else {
+            auto split = std::partition(order.begin() + start, order.begin() + end,
+                [&](uint32_t prim) { return bin_of(prim) <= best_split; });
+            mid = static_cast<size_t>(split - order.begin());
+        }
+    }
+
+    auto index = static_cast<uint32_t>(out.size());
+    out.emplace_back();
+    set_bounds(out[index], box);
+    out[index].count = 0;
+    out[index].axis = static_cast<uint8_t>(axis);
+    out[index].pad = 0;
+
+    bool parallel = std::min(mid - start, end - mid) >= parallel_task_threshold && reserve_threads(1) == 1;
+
+    if (!parallel) {
+        build_recursive(out, start, mid, depth + 1);
+        out[index].offset = build_recursive(out, mid, end, depth + 1);
+        return index;
+    }
+
+    // Build the near half on a helper thread and the far half here, each
+    // into a private array, then splice both in behind the parent. Leaf
+    // offsets index into `order` and need no fixing; interior ones do.
+    std::vector<LinearBVHNode> left_nodes, right_nodes;
+    std::thread helper([&]() { build_recursive(left_nodes, start, mid, depth + 1); });
+    build_recursive(right_nodes, mid, end, depth + 1);
+    helper.join();
+    release_threads(1);
+
+    auto append = [&out](const std::vector<LinearBVHNode> &sub) {
+        auto base = static_cast<uint32_t>(out.size());
+        for (auto node : sub) {
+            if (!node.is_leaf()) {
+                node.offset += base;
+            }
+            out.push_back(node);
+        }
+        return base;
+    };
+
+    append(left_nodes);
+    out[index].offset = append(right_nodes);
+
+    return index;
+}
+
+void BVHBuilder::collect_stats() {
+    stats.primitive_count = boxes.size();
+    stats.node_count = nodes.size();
+    stats.leaf_count = 0;
+    stats.max_depth = 0;
+
+    if (nodes.empty()) {
+        return;
+    }
+
+    std::vector<std::pair<uint32_t, int>> stack = { { 0, 1 } };
+    while (!stack.empty()) {
+        auto entry = stack.back();
+        stack.pop_back();
+
+        const auto &node = nodes[entry.first];
+        stats.max_depth = std::max(stats.max_depth, entry.second);
+
+        if (node.is_leaf()) {
+            stats.leaf_count++;
+        } else {
+            stack.push_back({ entry.first + 1, entry.second + 1 });
+            stack.push_back({ node.offset, entry.second + 1 });
+        }
+    }
+}
+
+/// @brief A BVH flattened into one contiguous array of 32-byte nodes, built
+///        with the surface area heuristic and traversed with an explicit
+///        stack, nearest child first. Drop-in replacement for BVHNode.
+class LinearBVH : public Hittable {
+    public:
+        std::vector<LinearBVHNode> nodes;
+        std::vector<shared_ptr<Hittable>> primitives;
+        Aabb box;
+        BVHBuildStats build_stats;
+
+    public:
+        LinearBVH() {}
+        LinearBVH(
+            __F_IN__ const HittableList &list,
+            __F_IN__ double time0,
+            __F_IN__ double time1,
+            __F_IN__ int max_prims_in_leaf = 4,
+            __F_IN__ int threads = 0
+        ) : LinearBVH(list.objects, time0, time1, max_prims_in_leaf, threads) {}
+        LinearBVH(
+            __F_IN__ const std::vector<shared_ptr<Hittable>> &src_objects,
+            __F_IN__ double time0,
+            __F_IN__ double time1,
+            __F_IN__ int max_prims_in_leaf = 4,
+            __F_IN__ int threads = 0
+        );
+
+        virtual bool hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const override;
+        virtual bool bounding_box(double time0, double time1, Aabb &output_box) const override {
+            output_box = box;
+            return !nodes.empty();
+        }
+};
+
+LinearBVH::LinearBVH(
+    const std::vector<shared_ptr<Hittable>> &src_objects,
+    double time0,
+    double time1,
+    int max_prims_in_leaf,
+    int threads
+) {
+    auto start_time = std::chrono::high_resolution_clock::now();
+    std::vector<Aabb> boxes(src_objects.size());
+
+    for (size_t i = 0; i < src_objects.size(); i++) {
+        if (!src_objects[i]->bounding_box(time0, time1, boxes[i])) {
+            std::cerr << "No bounding box in LinearBVH constructor.\n";
+        }
+    }
+
+    BVHBuilder builder(std::move(boxes), max_prims_in_leaf, threads);
+    nodes = std::move(builder.nodes);
+
+    primitives.reserve(src_objects.size());
+    for (auto index : builder.order) {
+        primitives.push_back(src_objects[index]);
+    }
+
+    if (!nodes.empty()) {
+        box = Aabb(
+            Point3(nodes[0].bounds_min[0], nodes[0].bounds_min[1], nodes[0].bounds_min[2]),
+            Point3(nodes[0].bounds_max[0], nodes[0].bounds_max[1], nodes[0].bounds_max[2])
+        );
+    }
+
+    auto end_time = std::chrono::high_resolution_clock::now();
+    build_stats = builder.stats;
+    build_stats.build_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+}
+
+bool LinearBVH::hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const {
+    if (nodes.empty()) {
+        return false;
+    }
+
+    Vec3 inv_dir(1.0 / r.direction().x(), 1.0 / r.direction().y(), 1.0 / r.direction().z());
+    bool dir_is_neg[3] = { inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0 };
+    auto origin = r.origin();
+
+    bool hit_anything = false;
+    auto closest_so_far = t_max;
+
+    uint32_t stack[128];
+    int stack_size = 0;
+    uint32_t current = 0;
+
+    while (true) {
+        const auto &node = nodes[current];
+        RT_STAT_INC(bvh_nodes_visited);
+        RT_STAT_INC(aabb_tests);
+
+        auto t0 = t_min;
+        auto t1 = closest_so_far;
+        for (int a = 0; a < 3 && t0 <= t1; a++) {
+            auto near = ((dir_is_neg[a] ? node.bounds_max[a] : node.bounds_min[a]) - origin[a]) * inv_dir[a];
+            auto far = ((dir_is_neg[a] ? node.bounds_min[a] : node.bounds_max[a]) - origin[a]) * inv_dir[a];
+            t0 = near > t0 ? near : t0;
+            t1 = far < t1 ? far : t1;
+        }
+
+        if (t0 <= t1) {
+            if (node.is_leaf()) {
+                for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                    if (primitives[i]->hit(r, t_min, closest_so_far, rec)) {
+                        hit_anything = true;
+                        closest_so_far = rec.t;
+                    }
+                }
+            } else {
+                // The first child holds the primitives on the low side of the
+                // split, so visit it first unless the ray travels downwards.
+                if (dir_is_neg[node.axis]) {
+                    stack[stack_size++] = current + 1;
+                    current = node.offset;
+                } else {
+                    stack[stack_size++] = node.offset;
+                    current = current + 1;
+                }
+                continue;
+            }
+        }
+
+        if (stack_size == 0) {
+            break;
+        }
+        current = stack[--stack_size];
+    }
+
+    return hit_anything;
+}
+
+#endif
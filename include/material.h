@@ -9,11 +9,29 @@
 
 struct HitRecord;
 
+/// @brief Which PDF a ScatterRecord carries for its non-specular lobe.
+enum class ScatterPdf {
+    None,
+    Cosine
+};
+
+/// @brief Result of Material::scatter(). The sampling PDF is stored inline
+///        and picked by `pdf_type`, so scattering never touches the heap.
 struct ScatterRecord {
     Ray specular_ray;
     bool is_specular;
     Color attenuation;
-    shared_ptr<Pdf> pdf_ptr;
+    ScatterPdf pdf_type = ScatterPdf::None;
+    CosinePdf cosine_pdf;
+
+    /// @brief The PDF to sample the scattered direction from, or nullptr for
+    ///        specular scattering. Points into this record.
+    const Pdf *pdf() const {
+        switch (pdf_type) {
+            case ScatterPdf::Cosine: return &cosine_pdf;
+            default: return nullptr;
+        }
+    }
 };
 
 class Material {
@@ -45,6 +63,12 @@ class Material {
         ) const {
             return Color(0, 0, 0);
         }
+
+        /// @brief Whether emitted() can be non-zero, so that shapes with
+        ///        this material are worth sampling as lights.
+        virtual bool is_emissive() const {
+            return false;
+        }
 };
 
 class Lambertian : public Material {
@@ -60,7 +84,8 @@ class Lambertian : public Material {
         ) const override {
             srec.is_specular = false;
             srec.attenuation = albedo->value(rec.u, rec.v, rec.p);
-            srec.pdf_ptr = make_shared<CosinePdf>(rec.normal);
+            srec.pdf_type = ScatterPdf::Cosine;
+            srec.cosine_pdf = CosinePdf(rec.normal);
             return true;
         }
 
@@ -84,10 +109,10 @@ class Metal : public Material {
             const Ray &r_in, const HitRecord &rec, ScatterRecord &srec
         ) const override {
             Vec3 reflected = reflect(normal(r_in.direction()), rec.normal);
-            srec.specular_ray = Ray(rec.p, reflected + fuzz * random_in_unit_sphere(), r_in.time());
+            srec.specular_ray = rec.spawn_ray(reflected + fuzz * random_in_unit_sphere(), r_in.time());
             srec.attenuation = albedo;
             srec.is_specular = true;
-            srec.pdf_ptr = nullptr;
+            srec.pdf_type = ScatterPdf::None;
             return true;
         }
 };
@@ -103,7 +128,7 @@ class Dielectric : public Material {
             const Ray &r_in, const HitRecord &rec, ScatterRecord &srec
         ) const override {
             srec.is_specular = true;
-            srec.pdf_ptr = nullptr;
+            srec.pdf_type = ScatterPdf::None;
             srec.attenuation = Color(1.0, 1.0, 1.0);
 
             double refraction_ratio = rec.front_face ? (1.0 / ir) : ir;
@@ -121,7 +146,7 @@ class Dielectric : public Material {
                 direction = refract(unit_direction, rec.normal, refraction_ratio);
             }
             
-            srec.specular_ray = Ray(rec.p, direction, r_in.time());
+            srec.specular_ray = rec.spawn_ray(direction, r_in.time());
             return true;
         }
 
@@ -149,6 +174,10 @@ class DiffuseLight : public Material {
             }
             return emit->value(u, v, p);
         }
+
+        virtual bool is_emissive() const override {
+            return true;
+        }
 };
 
 class Isotropic : public Material {
@@ -0,0 +1,287 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "rtweekend.h"
+
+#include "linear_bvh.h"
+#include "triangle_mesh.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/// @brief A read-only view of a whole file. On POSIX systems the file is
+///        mapped, so pages are only read from disk when first touched and
+///        are shared with the page cache; elsewhere it is read into memory.
+class MappedFile {
+    private:
+        const uint8_t *bytes = nullptr;
+        size_t length = 0;
+#ifdef _WIN32
+        std::vector<uint8_t> buffer;
+#endif
+
+    public:
+        MappedFile() {}
+        ~MappedFile();
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        /// @return nullptr if the file cannot be opened or is empty
+        static shared_ptr<MappedFile> open(__F_IN__ const std::string &path);
+
+        const uint8_t *data() const { return bytes; }
+        size_t size() const { return length; }
+};
+
+#ifdef _WIN32
+
+shared_ptr<MappedFile> MappedFile::open(const std::string &path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        return nullptr;
+    }
+
+    auto mapped = make_shared<MappedFile>();
+    mapped->buffer.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    if (mapped->buffer.empty() || !file.read(reinterpret_cast<char *>(mapped->buffer.data()), mapped->buffer.size())) {
+        return nullptr;
+    }
+    mapped->bytes = mapped->buffer.data();
+    mapped->length = mapped->buffer.size();
+    return mapped;
+}
+
+MappedFile::~MappedFile() {}
+
+#else
+
+shared_ptr<MappedFile> MappedFile::open(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        return nullptr;
+    }
+
+    auto mapped = make_shared<MappedFile>();
+    mapped->bytes = static_cast<const uint8_t *>(p);
+    mapped->length = static_cast<size_t>(st.st_size);
+    return mapped;
+}
+
+MappedFile::~MappedFile() {
+    if (bytes) {
+        munmap(const_cast<uint8_t *>(bytes), length);
+    }
+}
+
+#endif
+
+/// @brief Arrays stored in a mesh cache, in file order.
+enum MeshCacheSection {
+    MESH_CACHE_X, MESH_CACHE_Y, MESH_CACHE_Z,
+    MESH_CACHE_NX, MESH_CACHE_NY, MESH_CACHE_NZ,
+    MESH_CACHE_U, MESH_CACHE_V,
+    MESH_CACHE_INDICES,
+    MESH_CACHE_NODES,
+    MESH_CACHE_SECTION_COUNT
+};
+
+static const char mesh_cache_magic[8] = { 'R', 'T', 'M', 'E', 'S', 'H', '\r', '\n' };
+static const uint32_t mesh_cache_version = 1;
+static const uint32_t mesh_cache_endian = 0x01020304;
+static const size_t mesh_cache_alignment = 64;
+
+/// @brief Fixed header at the start of a mesh cache. Every array follows it
+///        at a 64-byte aligned offset, stored exactly as TriangleMesh reads
+///        it, so loading is a header check and a handful of pointers.
+///        An offset of 0 marks an absent array (normals, UVs).
+struct MeshCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;                ///< mesh_cache_endian as written by the producer
+    uint64_t vertex_count;
+    uint64_t triangle_count;
+    uint64_t node_count;
+    uint64_t leaf_count;
+    uint32_t max_depth;
+    uint32_t node_size;             ///< sizeof(LinearBVHNode) of the producer
+    uint64_t offsets[MESH_CACHE_SECTION_COUNT];
+};
+
+/// @brief Size in bytes of one section, given the counts in the header.
+inline uint64_t mesh_cache_section_bytes(const MeshCacheHeader &header, int section) {
+    switch (section) {
+        case MESH_CACHE_INDICES: return header.triangle_count * 3 * sizeof(uint32_t);
+        case MESH_CACHE_NODES: return header.node_count * sizeof(LinearBVHNode);
+        default: return header.vertex_count * sizeof(float);
+    }
+}
+
+/// @brief Writes a built mesh, BVH included, as a mesh cache. The material
+///        is not stored; whoever loads the cache supplies it.
+/// @return false if the file could not be written
+inline bool write_mesh_cache(__F_IN__ const TriangleMesh &mesh, __F_IN__ const std::string &path) {
+    const auto &view = mesh.arrays();
+    const void *arrays[MESH_CACHE_SECTION_COUNT] = {
+        view.x, view.y, view.z, view.nx, view.ny, view.nz, view.u, view.v, view.indices, view.nodes
+    };
+
+    MeshCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, mesh_cache_magic, sizeof(header.magic));
+    header.version = mesh_cache_version;
+    header.endian = mesh_cache_endian;
+    header.vertex_count = view.vertex_count;
+    header.triangle_count = view.triangle_count;
+    header.node_count = view.node_count;
+    header.leaf_count = mesh.build_stats.leaf_count;
+    header.max_depth = static_cast<uint32_t>(mesh.build_stats.max_depth);
+    header.node_size = sizeof(LinearBVHNode);
+
+    uint64_t offset = sizeof(header);
+    for (int s = 0; s < MESH_CACHE_SECTION_COUNT; s++) {
+        if (arrays[s]) {
+            offset = (offset + mesh_cache_alignment - 1) / mesh_cache_alignment * mesh_cache_alignment;
+            header.offsets[s] = offset;
+            offset += mesh_cache_section_bytes(header, s);
+        }
+    }
+
+    FILE *f = std::fopen(path.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+
+    bool ok = std::fwrite(&header, sizeof(header), 1, f) == 1;
+    uint64_t written = sizeof(header);
+    static const uint8_t zeros[mesh_cache_alignment] = {};
+    for (int s = 0; s < MESH_CACHE_SECTION_COUNT && ok; s++) {
+        if (!arrays[s]) {
+            continue;
+        }
+        auto bytes = static_cast<size_t>(mesh_cache_section_bytes(header, s));
+        ok = std::fwrite(zeros, 1, static_cast<size_t>(header.offsets[s] - written), f) == header.offsets[s] - written
+          && std::fwrite(arrays[s], 1, bytes, f) == bytes;
+        written = header.offsets[s] + bytes;
+    }
+
+    ok = std::fclose(f) == 0 && ok;
+    return ok;
+}
+
+/// @brief Maps a mesh cache and wraps it in a TriangleMesh that reads the
+///        mapped arrays in place. Only the header is checked: the arrays
+///        themselves are not touched until rays hit them, so opening a
+///        cache takes the same time whatever the size of the mesh.
+/// @return nullptr, after printing why, if the file is missing or not a
+///         cache this build can read
+inline shared_ptr<TriangleMesh> load_mesh_cache(__F_IN__ const std::string &path, __F_IN__ shared_ptr<Material> m) {
+    auto fail = [&](const char *why) {
+        std::cerr << "ERROR: " << why << " in mesh cache '" << path << "'.\n";
+        return shared_ptr<TriangleMesh>();
+    };
+
+    auto file = MappedFile::open(path);
+    if (!file) {
+        std::cerr << "ERROR: Could not open mesh cache '" << path << "'.\n";
+        return nullptr;
+    }
+    if (file->size() < sizeof(MeshCacheHeader)) {
+        return fail("Truncated header");
+    }
+
+    MeshCacheHeader header;
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (std::memcmp(header.magic, mesh_cache_magic, sizeof(header.magic)) != 0) {
+        return fail("Bad magic");
+    }
+    if (header.version != mesh_cache_version) {
+        return fail("Unsupported version");
+    }
+    if (header.endian != mesh_cache_endian || header.node_size != sizeof(LinearBVHNode)) {
+        return fail("Incompatible byte order or node layout");
+    }
+
+    // Bounding the counts by the file size first keeps the section sizes
+    // below from overflowing.
+    if (header.vertex_count > UINT32_MAX || header.triangle_count > file->size() || header.node_count > file->size()) {
+        return fail("Implausible counts");
+    }
+
+    const uint8_t *sections[MESH_CACHE_SECTION_COUNT] = {};
+    for (int s = 0; s < MESH_CACHE_SECTION_COUNT; s++) {
+        uint64_t offset = header.offsets[s];
+        if (offset == 0) {
+            continue;
+        }
+        if (offset % alignof(LinearBVHNode) != 0 || offset < sizeof(header)
+            || offset > file->size() || mesh_cache_section_bytes(header, s) > file->size() - offset) {
+            return fail("Section out of bounds");
+        }
+        sections[s] = file->data() + offset;
+    }
+
+    bool has_normals = sections[MESH_CACHE_NX] && sections[MESH_CACHE_NY] && sections[MESH_CACHE_NZ];
+    bool has_uvs = sections[MESH_CACHE_U] && sections[MESH_CACHE_V];
+    if (!sections[MESH_CACHE_X] || !sections[MESH_CACHE_Y] || !sections[MESH_CACHE_Z]
+        || !sections[MESH_CACHE_INDICES] || !sections[MESH_CACHE_NODES]
+        || (header.triangle_count > 0 && header.node_count == 0)) {
+        return fail("Missing section");
+    }
+
+    MeshView view;
+    view.x = reinterpret_cast<const float *>(sections[MESH_CACHE_X]);
+    view.y = reinterpret_cast<const float *>(sections[MESH_CACHE_Y]);
+    view.z = reinterpret_cast<const float *>(sections[MESH_CACHE_Z]);
+    if (has_normals) {
+        view.nx = reinterpret_cast<const float *>(sections[MESH_CACHE_NX]);
+        view.ny = reinterpret_cast<const float *>(sections[MESH_CACHE_NY]);
+        view.nz = reinterpret_cast<const float *>(sections[MESH_CACHE_NZ]);
+    }
+    if (has_uvs) {
+        view.u = reinterpret_cast<const float *>(sections[MESH_CACHE_U]);
+        view.v = reinterpret_cast<const float *>(sections[MESH_CACHE_V]);
+    }
+    view.indices = reinterpret_cast<const uint32_t *>(sections[MESH_CACHE_INDICES]);
+    view.nodes = reinterpret_cast<const LinearBVHNode *>(sections[MESH_CACHE_NODES]);
+    view.vertex_count = header.vertex_count;
+    view.triangle_count = header.triangle_count;
+    view.node_count = header.node_count;
+
+    auto mesh = make_shared<TriangleMesh>(view, file, m);
+    mesh->build_stats.leaf_count = header.leaf_count;
+    mesh->build_stats.max_depth = static_cast<int>(header.max_depth);
+    return mesh;
+}
+
+/// @brief True if `path` names a mesh cache by its extension.
+inline bool is_mesh_cache_path(__F_IN__ const std::string &path) {
+    static const char ext[] = ".rtmesh";
+    return path.size() >= sizeof(ext) - 1 && path.compare(path.size() - (sizeof(ext) - 1), sizeof(ext) - 1, ext) == 0;
+}
+
+#endif
@@ -0,0 +1,608 @@
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+#include "rtweekend.h"
+
+#include "triangle_mesh.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/// @brief Reads a whole file into memory and appends a '\0', so that
+///        strtof() and friends stop at the end of the file even when its
+///        last number is not followed by a newline. The file's own bytes
+///        are the first out.size() - 1.
+inline bool read_file(const std::string &path, std::vector<char> &out) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        return false;
+    }
+
+    auto size = static_cast<size_t>(file.tellg());
+    out.resize(size + 1);
+    out[size] = '\0';
+    file.seekg(0);
+    return static_cast<bool>(file.read(out.data(), static_cast<std::streamsize>(size)));
+}
+
+inline int loader_thread_count(int threads) {
+    return threads > 0 ? threads : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+/// @brief What one thread pulls out of its slice of an OBJ file. Face
+///        corners are triangulated as a fan and stored as (v, vt, vn)
+///        triples. Non-negative entries are absolute 0-based indices.
+///        Negative OBJ indices count back from the vertices seen so far, which
+///        for a chunk is only known up to the vertices of earlier chunks; they
+///        are stored as obj_relative + (index relative to the chunk start)
+///        and resolved once the earlier chunks' counts are known.
+struct ObjChunk {
+    std::vector<float> v, vt, vn;
+    std::vector<int64_t> corners;
+    bool ok = true;
+};
+
+static const int64_t obj_missing = std::numeric_limits<int64_t>::min();
+static const int64_t obj_relative = std::numeric_limits<int64_t>::min() / 2;
+
+inline const char *obj_skip_space(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+
+/// @brief Returns the start of the line after the one `p` is on.
+inline const char *skip_line(const char *p, const char *end) {
+    while (p < end && *p != '\n') {
+        p++;
+    }
+    return p < end ? p + 1 : end;
+}
+
+inline void parse_obj_chunk(const char *p, const char *end, ObjChunk &chunk) {
+    std::vector<int64_t> face;
+
+    // Turns one OBJ index into the encoding described on ObjChunk.
+    auto encode = [](long idx, size_t seen) -> int64_t {
+        if (idx > 0) {
+            return idx - 1;
+        }
+        if (idx < 0) {
+            return obj_relative + static_cast<int64_t>(seen) + idx;
+        }
+        return obj_missing;
+    };
+
+    while (p < end) {
+        const char *line = obj_skip_space(p, end);
+        const char *next = skip_line(line, end);
+
+        if (line + 1 < end && line[0] == 'v' && (line[1] == ' ' || line[1] == '\t')) {
+            char *q = const_cast<char *>(line + 1);
+            for (int k = 0; k < 3; k++) {
+                chunk.v.push_back(std::strtof(q, &q));
+            }
+        } else if (line + 2 < end && line[0] == 'v' && line[1] == 't' && (line[2] == ' ' || line[2] == '\t')) {
+            char *q = const_cast<char *>(line + 2);
+            chunk.vt.push_back(std::strtof(q, &q));
+            chunk.vt.push_back(std::strtof(q, &q));
+        } else if (line + 2 < end && line[0] == 'v' && line[1] == 'n' && (line[2] == ' ' || line[2] == '\t')) {
+            char *q = const_cast<char *>(line + 2);
+            for (int k = 0; k < 3; k++) {
+                chunk.vn.push_back(std::strtof(q, &q));
+            }
+        } else if (line + 1 < end && line[0] == 'f' && (line[1] == ' ' || line[1] == '\t')) {
+            face.clear();
+            const char *q = line + 1;
+            while (true) {
+                q = obj_skip_space(q, next);
+                if (q >= next || *q == '\n' || *q == '#') {
+                    break;
+                }
+
+                char *r;
+                long idx[3] = { 0, 0, 0 };
+                idx[0] = std::strtol(q, &r, 10);
+                if (r == q) {
+                    chunk.ok = false;
+                    break;
+                }
+                for (int k = 1; k < 3 && *r == '/'; k++) {
+                    idx[k] = std::strtol(r + 1, &r, 10);
+                }
+                q = r;
+
+                face.push_back(encode(idx[0], chunk.v.size() / 3));
+                face.push_back(encode(idx[1], chunk.vt.size() / 2));
+                face.push_back(encode(idx[2], chunk.vn.size() / 3));
+            }
+
+            size_t corner_count = face.size() / 3;
+            for (size_t k = 2; k < corner_count; k++) {
+                chunk.corners.insert(chunk.corners.end(), face.begin(), face.begin() + 3);
+                chunk.corners.insert(chunk.corners.end(), face.begin() + 3 * (k - 1), face.begin() + 3 * (k + 1));
+            }
+        }
+
+        p = next;
+    }
+}
+
+/// @brief Loads the triangles of a Wavefront OBJ file (v, vt, vn and f
+///        records; polygons are fanned). The file is split into one slice
+///        per thread at line boundaries and the slices are parsed in
+///        parallel. Corners that share position, UV and normal indices
+///        become one mesh vertex.
+/// @return false if the file cannot be read or is malformed
+inline bool load_obj(const std::string &path, MeshData &out, int threads = 0) {
+    std::vector<char> data;
+    if (!read_file(path, data)) {
+        std::cerr << "ERROR: Could not read OBJ file '" << path << "'.\n";
+        return false;
+    }
+
+    size_t size = data.size() - 1;
+    int n_threads = loader_thread_count(threads);
+    if (size < (1u << 20)) {
+        n_threads = 1;
+    }
+
+    const char *begin = data.data();
+    const char *end = begin + size;
+    std::vector<const char *> cuts = { begin };
+    for (int t = 1; t < n_threads; t++) {
+        const char *cut = std::max(cuts.back(), begin + size * t / n_threads);
+        cuts.push_back(skip_line(cut, end));
+    }
+    cuts.push_back(end);
+
+    std::vector<ObjChunk> chunks(n_threads);
+    std::vector<std::thread> workers;
+    for (int t = 1; t < n_threads; t++) {
+        workers.emplace_back(parse_obj_chunk, cuts[t], cuts[t + 1], std::ref(chunks[t]));
+    }
+    parse_obj_chunk(cuts[0], cuts[1], chunks[0]);
+    for (auto &w : workers) {
+        w.join();
+    }
+
+    // Concatenate the attribute arrays and resolve chunk-relative indices.
+    std::vector<float> v, vt, vn;
+    std::vector<int64_t> corners;
+    for (auto &chunk : chunks) {
+        if (!chunk.ok) {
+            std::cerr << "ERROR: Malformed face in OBJ file '" << path << "'.\n";
+            return false;
+        }
+
+        int64_t base[3] = {
+            static_cast<int64_t>(v.size() / 3), static_cast<int64_t>(vt.size() / 2), static_cast<int64_t>(vn.size() / 3)
+        };
+        for (size_t k = 0; k < chunk.corners.size(); k++) {
+            auto c = chunk.corners[k];
+            corners.push_back(c != obj_missing && c < 0 ? base[k % 3] + (c - obj_relative) : c);
+        }
+
+        v.insert(v.end(), chunk.v.begin(), chunk.v.end());
+        vt.insert(vt.end(), chunk.vt.begin(), chunk.vt.end());
+        vn.insert(vn.end(), chunk.vn.begin(), chunk.vn.end());
+        chunk = ObjChunk();
+    }
+
+    int64_t counts[3] = {
+        static_cast<int64_t>(v.size() / 3), static_cast<int64_t>(vt.size() / 2), static_cast<int64_t>(vn.size() / 3)
+    };
+    bool use_uvs = true;
+    bool use_normals = true;
+    for (size_t k = 0; k < corners.size(); k++) {
+        auto c = corners[k];
+        if (c == obj_missing) {
+            if (k % 3 == 0) {
+                std::cerr << "ERROR: Face without a position in OBJ file '" << path << "'.\n";
+                return false;
+            }
+            (k % 3 == 1 ? use_uvs : use_normals) = false;
+        } else if (c < 0 || c >= counts[k % 3]) {
+            std::cerr << "ERROR: Index out of range in OBJ file '" << path << "'.\n";
+            return false;
+        }
+    }
+
+    out = MeshData();
+    out.indices.reserve(corners.size() / 3);
+
+    // Positions only: the OBJ vertices are the mesh vertices.
+    if (!use_uvs && !use_normals) {
+        out.x.resize(counts[0]);
+        out.y.resize(counts[0]);
+        out.z.resize(counts[0]);
+        for (int64_t i = 0; i < counts[0]; i++) {
+            out.x[i] = v[3 * i];
+            out.y[i] = v[3 * i + 1];
+            out.z[i] = v[3 * i + 2];
+        }
+        for (size_t k = 0; k < corners.size(); k += 3) {
+            out.indices.push_back(static_cast<uint32_t>(corners[k]));
+        }
+        return true;
+    }
+
+    struct CornerHash {
+        size_t operator()(const std::array<int64_t, 3> &c) const {
+            return static_cast<size_t>(c[0] * 0x9e3779b97f4a7c15ULL ^ c[1] * 0xbf58476d1ce4e5b9ULL ^ c[2] * 0x94d049bb133111ebULL);
+        }
+    };
+    std::unordered_map<std::array<int64_t, 3>, uint32_t, CornerHash> unique;
+    unique.reserve(counts[0] * 2);
+
+    for (size_t k = 0; k < corners.size(); k += 3) {
+        std::array<int64_t, 3> key = {
+            corners[k], use_uvs ? corners[k + 1] : 0, use_normals ? corners[k + 2] : 0
+        };
+        auto found = unique.find(key);
+        if (found != unique.end()) {
+            out.indices.push_back(found->second);
+            continue;
+        }
+
+        auto index = static_cast<uint32_t>(out.x.size());
+        unique.emplace(key, index);
+        out.indices.push_back(index);
+
+        out.x.push_back(v[3 * key[0]]);
+        out.y.push_back(v[3 * key[0] + 1]);
+        out.z.push_back(v[3 * key[0] + 2]);
+        if (use_uvs) {
+            out.u.push_back(vt[2 * key[1]]);
+            out.v.push_back(vt[2 * key[1] + 1]);
+        }
+        if (use_normals) {
+            out.nx.push_back(vn[3 * key[2]]);
+            out.ny.push_back(vn[3 * key[2] + 1]);
+            out.nz.push_back(vn[3 * key[2] + 2]);
+        }
+    }
+
+    return true;
+}
+
+/// @brief Scalar types a PLY property can have.
+enum class PlyType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64, Invalid };
+
+inline PlyType ply_type(const std::string &name) {
+    if (name == "char" || name == "int8") return PlyType::Int8;
+    if (name == "uchar" || name == "uint8") return PlyType::UInt8;
+    if (name == "short" || name == "int16") return PlyType::Int16;
+    if (name == "ushort" || name == "uint16") return PlyType::UInt16;
+    if (name == "int" || name == "int32") return PlyType::Int32;
+    if (name == "uint" || name == "uint32") return PlyType::UInt32;
+    if (name == "float" || name == "float32") return PlyType::Float32;
+    if (name == "double" || name == "float64") return PlyType::Float64;
+    return PlyType::Invalid;
+}
+
+inline size_t ply_type_size(PlyType type) {
+    switch (type) {
+        case PlyType::Int8: case PlyType::UInt8: return 1;
+        case PlyType::Int16: case PlyType::UInt16: return 2;
+        case PlyType::Int32: case PlyType::UInt32: case PlyType::Float32: return 4;
+        case PlyType::Float64: return 8;
+        default: return 0;
+    }
+}
+
+/// @brief Reads one binary PLY scalar, swapping bytes if the file's
+///        endianness differs from the host's.
+inline double ply_read(const char *p, PlyType type, bool swap) {
+    char bytes[8];
+    size_t size = ply_type_size(type);
+    for (size_t k = 0; k < size; k++) {
+        bytes[k] = swap ? p[size - 1 - k] : p[k];
+    }
+
+    switch (type) {
+        case PlyType::Int8: { int8_t x; std::memcpy(&x, bytes, 1); return x; }
+        case PlyType::UInt8: { uint8_t x; std::memcpy(&x, bytes, 1); return x; }
+        case PlyType::Int16: { int16_t x; std::memcpy(&x, bytes, 2); return x; }
+        case PlyType::UInt16: { uint16_t x; std::memcpy(&x, bytes, 2); return x; }
+        case PlyType::Int32: { int32_t x; std::memcpy(&x, bytes, 4); return x; }
+        case PlyType::UInt32: { uint32_t x; std::memcpy(&x, bytes, 4); return x; }
+        case PlyType::Float32: { float x; std::memcpy(&x, bytes, 4); return x; }
+        case PlyType::Float64: { double x; std::memcpy(&x, bytes, 8); return x; }
+        default: return 0;
+    }
+}
+
+struct PlyProperty {
+    std::string name;
+    PlyType type = PlyType::Invalid;
+    PlyType count_type = PlyType::Invalid;  ///< Set for list properties only
+};
+
+struct PlyElement {
+    std::string name;
+    size_t count = 0;
+    std::vector<PlyProperty> properties;
+};
+
+/// @brief Loads the triangles of a PLY file. Binary files (either
+///        endianness) are the fast path: vertices have a fixed stride and
+///        are converted on several threads, faces are walked once. ASCII
+///        files are read too. Polygons are fanned. Recognised vertex
+///        properties are x/y/z, nx/ny/nz and u/v (or s/t, texture_u/v).
+/// @return false if the file cannot be read or is malformed
+inline bool load_ply(const std::string &path, MeshData &out, int threads = 0) {
+    std::vector<char> data;
+    if (!read_file(path, data)) {
+        std::cerr << "ERROR: Could not read PLY file '" << path << "'.\n";
+        return false;
+    }
+
+    auto fail = [&](const char *why) {
+        std::cerr << "ERROR: " << why << " in PLY file '" << path << "'.\n";
+        return false;
+    };
+
+    // Header
+    const size_t size = data.size() - 1;
+    const char *end = data.data() + size;
+    const char *body = nullptr;
+    static const char end_header[] = "end_header";
+    for (const char *p = data.data(); p < end; p = skip_line(p, end)) {
+        if (static_cast<size_t>(end - p) >= sizeof(end_header) - 1 && std::strncmp(p, end_header, sizeof(end_header) - 1) == 0) {
+            body = skip_line(p, end);
+            break;
+        }
+    }
+    if (size < 3 || std::strncmp(data.data(), "ply", 3) != 0 || !body) {
+        return fail("Missing header");
+    }
+
+    std::istringstream header(std::string(data.data(), static_cast<size_t>(body - data.data())));
+    std::string line, format;
+    std::vector<PlyElement> elements;
+    while (std::getline(header, line)) {
+        std::istringstream words(line);
+        std::string word;
+        words >> word;
+        if (word == "format") {
+            words >> format;
+        } else if (word == "element") {
+            elements.emplace_back();
+            words >> elements.back().name >> elements.back().count;
+        } else if (word == "property" && !elements.empty()) {
+            PlyProperty prop;
+            std::string type;
+            words >> type;
+            if (type == "list") {
+                std::string count_type, item_type;
+                words >> count_type >> item_type;
+                prop.count_type = ply_type(count_type);
+                prop.type = ply_type(item_type);
+            } else {
+                prop.type = ply_type(type);
+            }
+            words >> prop.name;
+            if (prop.type == PlyType::Invalid || (type == "list" && prop.count_type == PlyType::Invalid)) {
+                return fail("Unknown property type");
+            }
+            elements.back().properties.push_back(prop);
+        }
+    }
+
+    bool ascii = format == "ascii";
+    bool little = format == "binary_little_endian";
+    if (!ascii && !little && format != "binary_big_endian") {
+        return fail("Unknown format");
+    }
+    const uint16_t probe = 1;
+    bool host_little = *reinterpret_cast<const uint8_t *>(&probe) == 1;
+    bool swap = !ascii && little != host_little;
+
+    out = MeshData();
+    const char *p = body;
+
+    // ASCII bodies are whitespace separated numbers in the same order.
+    // Running out of them before the header's counts are met is an error.
+    char *cursor = const_cast<char *>(body);
+    bool ascii_short = false;
+    auto ascii_next = [&]() {
+        char *start = cursor;
+        double value = std::strtod(start, &cursor);
+        ascii_short = ascii_short || cursor == start;
+        return value;
+    };
+
+    for (const auto &element : elements) {
+        bool fixed_stride = true;
+        size_t stride = 0;
+        for (const auto &prop : element.properties) {
+            fixed_stride = fixed_stride && prop.count_type == PlyType::Invalid;
+            stride += ply_type_size(prop.type);
+        }
+
+        if (element.name == "vertex") {
+            // Where each recognised attribute sits within a vertex.
+            const char *names[8][3] = {
+                { "x", "x", "x" }, { "y", "y", "y" }, { "z", "z", "z" },
+                { "nx", "nx", "nx" }, { "ny", "ny", "ny" }, { "nz", "nz", "nz" },
+                { "u", "s", "texture_u" }, { "v", "t", "texture_v" }
+            };
+            int slot_of[64];
+            size_t offset_of[64];
+            bool has[8] = {};
+            size_t offset = 0;
+            for (size_t k = 0; k < element.properties.size() && k < 64; k++) {
+                slot_of[k] = -1;
+                offset_of[k] = offset;
+                offset += ply_type_size(element.properties[k].type);
+                for (int s = 0; s < 8; s++) {
+                    const auto &name = element.properties[k].name;
+                    if (name == names[s][0] || name == names[s][1] || name == names[s][2]) {
+                        slot_of[k] = s;
+                        has[s] = true;
+                    }
+                }
+            }
+            if (!fixed_stride || element.properties.size() > 64 || !has[0] || !has[1] || !has[2]) {
+                return fail("Unsupported vertex layout");
+            }
+
+            size_t n = element.count;
+            std::vector<float> *slots[8] = { &out.x, &out.y, &out.z, &out.nx, &out.ny, &out.nz, &out.u, &out.v };
+            for (int s = 0; s < 8; s++) {
+                bool group = s < 3 ? true : s < 6 ? (has[3] && has[4] && has[5]) : (has[6] && has[7]);
+                if (group) {
+                    slots[s]->resize(n);
+                } else {
+                    slots[s] = nullptr;
+                }
+            }
+
+            auto convert = [&](size_t first, size_t last, const char *src) {
+                for (size_t i = first; i < last; i++) {
+                    for (size_t k = 0; k < element.properties.size(); k++) {
+                        double value = ascii ? ascii_next()
+                                             : ply_read(src + i * stride + offset_of[k], element.properties[k].type, swap);
+                        if (slot_of[k] >= 0 && slots[slot_of[k]]) {
+                            (*slots[slot_of[k]])[i] = static_cast<float>(value);
+                        }
+                    }
+                }
+            };
+
+            if (ascii) {
+                convert(0, n, nullptr);
+                if (ascii_short) {
+                    return fail("Truncated vertex data");
+                }
+            } else {
+                if (static_cast<size_t>(end - p) < n * stride) {
+                    return fail("Truncated vertex data");
+                }
+                int n_threads = n < (1u << 16) ? 1 : loader_thread_count(threads);
+                std::vector<std::thread> workers;
+                for (int t = 1; t < n_threads; t++) {
+                    workers.emplace_back(convert, n * t / n_threads, n * (t + 1) / n_threads, p);
+                }
+                convert(0, n / n_threads, p);
+                for (auto &w : workers) {
+                    w.join();
+                }
+                p += n * stride;
+            }
+        } else if (element.name == "face") {
+            out.indices.reserve(element.count * 3);
+            std::vector<uint32_t> polygon;
+
+            for (size_t i = 0; i < element.count; i++) {
+                for (const auto &prop : element.properties) {
+                    bool is_indices = prop.name == "vertex_indices" || prop.name == "vertex_index";
+                    size_t count = 1;
+                    if (prop.count_type != PlyType::Invalid) {
+                        if (!ascii && static_cast<size_t>(end - p) < ply_type_size(prop.count_type)) {
+                            return fail("Truncated face data");
+                        }
+                        count = static_cast<size_t>(ascii ? ascii_next() : ply_read(p, prop.count_type, swap));
+                        p += ascii ? 0 : ply_type_size(prop.count_type);
+                    }
+
+                    size_t item = ply_type_size(prop.type);
+                    if (!ascii && static_cast<size_t>(end - p) < count * item) {
+                        return fail("Truncated face data");
+                    }
+
+                    polygon.clear();
+                    for (size_t k = 0; k < count && !ascii_short; k++) {
+                        double value = ascii ? ascii_next() : ply_read(p + k * item, prop.type, swap);
+                        polygon.push_back(static_cast<uint32_t>(value));
+                    }
+                    p += ascii ? 0 : count * item;
+                    if (ascii_short) {
+                        return fail("Truncated face data");
+                    }
+
+                    if (is_indices) {
+                        for (size_t k = 2; k < polygon.size(); k++) {
+                            out.indices.insert(out.indices.end(), { polygon[0], polygon[k - 1], polygon[k] });
+                        }
+                    }
+                }
+            }
+        } else if (ascii) {
+            // Skip elements we do not use, value by value.
+            for (size_t i = 0; i < element.count; i++) {
+                for (const auto &prop : element.properties) {
+                    size_t count = prop.count_type != PlyType::Invalid ? static_cast<size_t>(ascii_next()) : 1;
+                    for (size_t k = 0; k < count && !ascii_short; k++) {
+                        ascii_next();
+                    }
+                    if (ascii_short) {
+                        return fail("Truncated data");
+                    }
+                }
+            }
+        } else if (fixed_stride) {
+            p += std::min(element.count * stride, static_cast<size_t>(end - p));
+        } else {
+            for (size_t i = 0; i < element.count; i++) {
+                for (const auto &prop : element.properties) {
+                    size_t count = 1;
+                    if (prop.count_type != PlyType::Invalid) {
+                        if (static_cast<size_t>(end - p) < ply_type_size(prop.count_type)) {
+                            return fail("Truncated data");
+                        }
+                        count = static_cast<size_t>(ply_read(p, prop.count_type, swap));
+                        p += ply_type_size(prop.count_type);
+                    }
+                    if (static_cast<size_t>(end - p) < count * ply_type_size(prop.type)) {
+                        return fail("Truncated data");
+                    }
+                    p += count * ply_type_size(prop.type);
+                }
+            }
+        }
+    }
+
+    for (auto index : out.indices) {
+        if (index >= out.vertex_count()) {
+            out = MeshData();
+            return fail("Index out of range");
+        }
+    }
+    return true;
+}
+
+/// @brief Loads an OBJ or PLY file, picked by extension.
+inline bool load_mesh(const std::string &path, MeshData &out, int threads = 0) {
+    auto dot = path.rfind('.');
+    std::string ext = dot == std::string::npos ? "" : path.substr(dot + 1);
+    for (auto &ch : ext) {
+        ch = static_cast<char>(tolower(ch));
+    }
+
+    if (ext == "ply") {
+        return load_ply(path, out, threads);
+    }
+    if (ext == "obj") {
+        return load_obj(path, out, threads);
+    }
+
+    std::cerr << "ERROR: Unknown mesh format '" << path << "'.\n";
+    return false;
+}
+
+#endif
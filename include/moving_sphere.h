@@ -6,7 +6,7 @@
 #include "aabb.h"
 #include "hittable.h"
 
-class MovingSphere : public Hittable {
+class MovingSphere final : public Hittable {
     public:
         Point3 center0, center1;
         double time0, time1;
@@ -27,6 +27,10 @@ class MovingSphere : public Hittable {
         virtual bool hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const override;
         virtual bool bounding_box(double _time0, double _time1, Aabb &output_box) const override;
 
+        virtual PrimitiveKind kind() const override {
+            return PrimitiveKind::MovingSphere;
+        }
+
         Point3 center(double time) const;
 };
 
@@ -35,9 +39,12 @@ Point3 MovingSphere::center(double time) const {
 }
 
 bool MovingSphere::hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const {
-    Vec3 oc = r.origin() - center(r.time());
-    auto a = r.direction().length_squared();
-    auto half_b = dot(oc, r.direction());
+    RT_STAT_INC(moving_sphere_tests);
+    // In double for the same reason as Sphere::hit().
+    Vec3T<double> oc = Vec3T<double>(r.origin()) - Vec3T<double>(center(r.time()));
+    Vec3T<double> dir(r.direction());
+    auto a = dir.length_squared();
+    auto half_b = dot(oc, dir);
     auto c = oc.length_squared() - radius * radius;
 
     auto discriminant = half_b * half_b - a * c;
@@ -47,9 +54,9 @@ bool MovingSphere::hit(const Ray &r, double t_min, double t_max, HitRecord &rec)
     auto sqrtd = sqrt(discriminant);
 
     auto root = (-half_b - sqrtd) / a;
-    if (root < t_min || t_max < root) {
+    if (root <= t_min || t_max < root) {
         root = (-half_b + sqrtd) / a;
-        if (root < t_min || t_max < root) {
+        if (root <= t_min || t_max < root) {
             return false;
         }
     }
@@ -58,7 +65,7 @@ bool MovingSphere::hit(const Ray &r, double t_min, double t_max, HitRecord &rec)
     rec.p = r.at(rec.t);
     auto outward_normal = (rec.p - center(r.time())) / radius;
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mat_ptr;
+    rec.mat_ptr = mat_ptr.get();
 
     return true;
 }
@@ -47,6 +47,7 @@ class CosinePdf : public Pdf {
         Onb uvw;
 
     public:
+        CosinePdf() {}
         CosinePdf(
             __F_IN__ const Vec3 &w
         ) { uvw.build_from_w(w); }
@@ -54,6 +55,7 @@ class CosinePdf : public Pdf {
         virtual double value(
             __F_IN__ const Vec3 &direction
         ) const override {
+            RT_STAT_INC(pdf_evaluations);
             auto cosine = dot(normal(direction), uvw.w());
             return (cosine <= 0) ? 0 : cosine / PI;
         }
@@ -63,20 +65,24 @@ class CosinePdf : public Pdf {
         }
 };
 
+/// @brief Samples directions towards a Hittable. Does not own the target,
+///        which must outlive the PDF; meant to live on the stack for one
+///        bounce.
 class HittablePdf : public Pdf {
     public:
         Point3 o;
-        shared_ptr<Hittable> ptr;
+        const Hittable *ptr;
 
     public:
         HittablePdf(
             __F_IN__ const Point3 &origin,
-            __F_IN__ shared_ptr<Hittable> p
-        ) : o(origin), ptr(p) {}
+            __F_IN__ const Hittable &p
+        ) : o(origin), ptr(&p) {}
 
         virtual double value(
             __F_IN__ const Vec3 &direction
         ) const override {
+            RT_STAT_INC(pdf_evaluations);
             return ptr->pdf_value(o, direction);
         }
 
@@ -85,30 +91,13 @@ class HittablePdf : public Pdf {
         }
 };
 
-class MixturePdf : public Pdf {
-    public:
-        shared_ptr<Pdf> p[2];
-
-    public:
-        MixturePdf(
-            __F_IN__ shared_ptr<Pdf> p0,
-            __F_IN__ shared_ptr<Pdf> p1
-        ) {
-            p[0] = p0;
-            p[1] = p1;
-        }
-
-        virtual double value(const Vec3 &direction) const override {
-            return 0.5 * p[0]->value(direction) + 0.5 * p[1]->value(direction);
-        }
-
-        virtual Vec3 generate() const override {
-            if (random_double2() < 0.5) {
-                return p[0]->generate();
-            } else {
-                return p[1]->generate();
-            }
-        }
-};
+/// @brief Multiple importance sampling weight, by the power heuristic
+///        (beta = 2), of a sample drawn with density pdf_a that the other
+///        strategy would have drawn with density pdf_b. pdf_a must be > 0.
+inline double power_heuristic(double pdf_a, double pdf_b) {
+    auto a = pdf_a * pdf_a;
+    auto b = pdf_b * pdf_b;
+    return a / (a + b);
+}
 
 #endif
\ No newline at end of file
@@ -0,0 +1,471 @@
+#ifndef PRIMITIVE_STORE_H
+#define PRIMITIVE_STORE_H
+
+#include "rtweekend.h"
+
+#include "aarect.h"
+#include "box.h"
+#include "hittable.h"
+#include "moving_sphere.h"
+#include "sphere.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+/// @brief A primitive's compact ID: its kind in the top four bits and its
+///        index into that kind's array of a PrimitiveStore in the rest.
+using PrimitiveId = uint32_t;
+
+inline PrimitiveId make_primitive_id(PrimitiveKind kind, uint32_t index) {
+    return static_cast<uint32_t>(kind) << 28 | index;
+}
+
+inline PrimitiveKind primitive_kind(PrimitiveId id) {
+    return static_cast<PrimitiveKind>(id >> 28);
+}
+
+inline uint32_t primitive_index(PrimitiveId id) {
+    return id & 0x0fffffffu;
+}
+
+/// @brief The closest primitive hit_run() has found so far. When deferred
+///        is set its record is still to be filled, which set_hit_record()
+///        does once the traversal is over; otherwise the record passed to
+///        hit_run() already holds it. axis and k are the face a box was
+///        hit on.
+struct LeafHit {
+    bool deferred = false;
+    PrimitiveId id = 0;
+    int axis = 0;
+    double k = 0;
+};
+
+/// @brief The primitives of a BVH, each concrete type by value in an array
+///        of its own and addressed by PrimitiveId. A leaf hands a run of
+///        primitives of one kind, consecutive in that kind's array, to
+///        hit_run(), which switches on the kind once and loops over the
+///        run with calls the compiler resolves statically (the classes are
+///        final). Spheres and rects are also kept structure-of-arrays and
+///        tested in branch-free batches. Primitives of any other type,
+///        custom ones included, are kept by pointer and called through
+///        Hittable as before.
+///
+///        Batched spheres, rects and boxes do not fill a HitRecord for
+///        every closer hit: the record, with its normal and (for spheres)
+///        trigonometric u, v, is filled once per ray by set_hit_record().
+class PrimitiveStore {
+    public:
+        /// Runs are tested this many primitives at a time: the batch is
+        /// intersected branch-free against one t_max, then reduced.
+        static const int batch_size = 8;
+
+        std::vector<Sphere> spheres;
+        std::vector<MovingSphere> moving_spheres;
+        std::vector<XYRect> xy_rects;
+        std::vector<XZRect> xz_rects;
+        std::vector<YZRect> yz_rects;
+        std::vector<Box> boxes;
+        std::vector<shared_ptr<Hittable>> others;
+
+    private:
+        struct SphereArrays {
+            std::vector<double> cx, cy, cz, radius;
+        };
+
+        /// u and v are a rect's two in-plane axes in xyz order.
+        struct RectArrays {
+            std::vector<double> u0, u1, v0, v1, k;
+        };
+
+        SphereArrays sphere_geometry;
+        /// Indexed by the axis the rects are perpendicular to.
+        RectArrays rect_geometry[3];
+
+    public:
+        /// @brief Copies object into the array of its kind.
+        /// @return The object's ID
+        PrimitiveId add(__F_IN__ const shared_ptr<Hittable> &object);
+
+        /// @brief Intersects the count primitives from first on, all of
+        ///        first's kind, finding what calling their hit() in order
+        ///        would.
+        /// @param t_max Lowered to the distance of the closest hit
+        /// @param hit Set to the closest hit, if there is one
+        /// @param rec Written only for kinds that are not deferred
+        /// @return Whether any primitive was hit before t_max
+        bool hit_run(
+            __F_IN__ PrimitiveId first,
+            __F_IN__ uint32_t count,
+            __F_IN__ const Ray &r,
+            __F_IN__ double t_min,
+            __F_INOUT__ double &t_max,
+            __F_INOUT__ LeafHit &hit,
+            __F_OUT__ HitRecord &rec
+        ) const;
+
+        /// @brief Fills rec for a deferred hit found at distance t.
+        void set_hit_record(
+            __F_IN__ const LeafHit &hit,
+            __F_IN__ const Ray &r,
+            __F_IN__ double t,
+            __F_OUT__ HitRecord &rec
+        ) const;
+
+        /// @brief hit_packet() of the count primitives from first on.
+        void hit_packet_run(
+            __F_IN__ PrimitiveId first,
+            __F_IN__ uint32_t count,
+            __F_INOUT__ RayPacket8 &packet,
+            __F_IN__ double t_min,
+            __F_OUT__ HitRecord recs[RayPacket8::size],
+            __F_INOUT__ uint32_t &hit_mask
+        ) const;
+
+    private:
+        bool hit_spheres(uint32_t begin, uint32_t end, const Ray &r, double t_min, double &t_max, LeafHit &hit) const;
+        bool hit_boxes(uint32_t begin, uint32_t end, const Ray &r, double t_min, double &t_max, LeafHit &hit) const;
+
+        /// @param Axis The axis the rects are perpendicular to
+        template <int Axis>
+        bool hit_rects(uint32_t begin, uint32_t end, const Ray &r, double t_min, double &t_max, LeafHit &hit) const;
+
+        /// @brief Plain hit() in order, for kinds that fill rec themselves.
+        template <typename T>
+        static bool hit_each(
+            const std::vector<T> &objects, uint32_t begin, uint32_t end,
+            const Ray &r, double t_min, double &t_max, LeafHit &hit, HitRecord &rec
+        );
+
+        template <typename T>
+        static void hit_packet_each(
+            const std::vector<T> &objects, uint32_t begin, uint32_t end,
+            RayPacket8 &packet, double t_min, HitRecord recs[RayPacket8::size], uint32_t &hit_mask
+        );
+
+        void add_rect(int axis, double u0, double u1, double v0, double v1, double k);
+};
+
+PrimitiveId PrimitiveStore::add(const shared_ptr<Hittable> &object) {
+    auto kind = object->kind();
+    uint32_t index = 0;
+
+    switch (kind) {
+        case PrimitiveKind::Sphere: {
+            const auto &s = static_cast<const Sphere &>(*object);
+            index = static_cast<uint32_t>(spheres.size());
+            spheres.push_back(s);
+            sphere_geometry.cx.push_back(s.center.x());
+            sphere_geometry.cy.push_back(s.center.y());
+            sphere_geometry.cz.push_back(s.center.z());
+            sphere_geometry.radius.push_back(s.radius);
+            break;
+        }
+        case PrimitiveKind::MovingSphere:
+            index = static_cast<uint32_t>(moving_spheres.size());
+            moving_spheres.push_back(static_cast<const MovingSphere &>(*object));
+            break;
+        case PrimitiveKind::XYRect: {
+            const auto &q = static_cast<const XYRect &>(*object);
+            index = static_cast<uint32_t>(xy_rects.size());
+            xy_rects.push_back(q);
+            add_rect(2, q.x0, q.x1, q.y0, q.y1, q.k);
+            break;
+        }
+        case PrimitiveKind::XZRect: {
+            const auto &q = static_cast<const XZRect &>(*object);
+            index = static_cast<uint32_t>(xz_rects.size());
+            xz_rects.push_back(q);
+            add_rect(1, q.x0, q.x1, q.z0, q.z1, q.k);
+            break;
+        }
+        case PrimitiveKind::YZRect: {
+            const auto &q = static_cast<const YZRect &>(*object);
+            index = static_cast<uint32_t>(yz_rects.size());
+            yz_rects.push_back(q);
+            add_rect(0, q.y0, q.y1, q.z0, q.z1, q.k);
+            break;
+        }
+        case PrimitiveKind::Box:
+            index = static_cast<uint32_t>(boxes.size());
+            boxes.push_back(static_cast<const Box &>(*object));
+            break;
+        default:
+            kind = PrimitiveKind::Other;
+            index = static_cast<uint32_t>(others.size());
+            others.push_back(object);
+            break;
+    }
+
+    return make_primitive_id(kind, index);
+}
+
+inline void PrimitiveStore::add_rect(int axis, double u0, double u1, double v0, double v1, double k) {
+    auto &g = rect_geometry[axis];
+    g.u0.push_back(u0);
+    g.u1.push_back(u1);
+    g.v0.push_back(v0);
+    g.v1.push_back(v1);
+    g.k.push_back(k);
+}
+
+inline bool PrimitiveStore::hit_run(
+    PrimitiveId first, uint32_t count, const Ray &r, double t_min, double &t_max, LeafHit &hit, HitRecord &rec
+) const {
+    auto begin = primitive_index(first);
+    auto end = begin + count;
+
+    switch (primitive_kind(first)) {
+        case PrimitiveKind::Sphere:
+            return hit_spheres(begin, end, r, t_min, t_max, hit);
+        case PrimitiveKind::MovingSphere:
+            return hit_each(moving_spheres, begin, end, r, t_min, t_max, hit, rec);
+        case PrimitiveKind::XYRect:
+            return hit_rects<2>(begin, end, r, t_min, t_max, hit);
+        case PrimitiveKind::XZRect:
+            return hit_rects<1>(begin, end, r, t_min, t_max, hit);
+        case PrimitiveKind::YZRect:
+            return hit_rects<0>(begin, end, r, t_min, t_max, hit);
+        case PrimitiveKind::Box:
+            return hit_boxes(begin, end, r, t_min, t_max, hit);
+        default: {
+            bool hit_anything = false;
+            for (auto i = begin; i < end; i++) {
+                if (others[i]->hit(r, t_min, t_max, rec)) {
+                    hit_anything = true;
+                    t_max = rec.t;
+                    hit.deferred = false;
+                }
+            }
+            return hit_anything;
+        }
+    }
+}
+
+inline void PrimitiveStore::set_hit_record(const LeafHit &hit, const Ray &r, double t, HitRecord &rec) const {
+    auto index = primitive_index(hit.id);
+
+    switch (primitive_kind(hit.id)) {
+        case PrimitiveKind::Sphere:
+            spheres[index].set_hit_record(r, t, rec);
+            break;
+        case PrimitiveKind::XYRect:
+            xy_rects[index].set_hit_record(r, t, rec);
+            break;
+        case PrimitiveKind::XZRect:
+            xz_rects[index].set_hit_record(r, t, rec);
+            break;
+        case PrimitiveKind::YZRect:
+            yz_rects[index].set_hit_record(r, t, rec);
+            break;
+        case PrimitiveKind::Box:
+            boxes[index].set_hit_record(r, t, hit.axis, hit.k, rec);
+            break;
+        default:
+            break;
+    }
+}
+
+inline void PrimitiveStore::hit_packet_run(
+    PrimitiveId first, uint32_t count, RayPacket8 &packet, double t_min, HitRecord recs[RayPacket8::size], uint32_t &hit_mask
+) const {
+    auto begin = primitive_index(first);
+    auto end = begin + count;
+
+    switch (primitive_kind(first)) {
+        case PrimitiveKind::Sphere:
+            hit_packet_each(spheres, begin, end, packet, t_min, recs, hit_mask);
+            break;
+        case PrimitiveKind::MovingSphere:
+            hit_packet_each(moving_spheres, begin, end, packet, t_min, recs, hit_mask);
+            break;
+        case PrimitiveKind::XYRect:
+            hit_packet_each(xy_rects, begin, end, packet, t_min, recs, hit_mask);
+            break;
+        case PrimitiveKind::XZRect:
+            hit_packet_each(xz_rects, begin, end, packet, t_min, recs, hit_mask);
+            break;
+        case PrimitiveKind::YZRect:
+            hit_packet_each(yz_rects, begin, end, packet, t_min, recs, hit_mask);
+            break;
+        case PrimitiveKind::Box:
+            hit_packet_each(boxes, begin, end, packet, t_min, recs, hit_mask);
+            break;
+        default:
+            for (auto i = begin; i < end; i++) {
+                others[i]->hit_packet(packet, t_min, recs, hit_mask);
+            }
+            break;
+    }
+}
+
+template <typename T>
+inline bool PrimitiveStore::hit_each(
+    const std::vector<T> &objects, uint32_t begin, uint32_t end,
+    const Ray &r, double t_min, double &t_max, LeafHit &hit, HitRecord &rec
+) {
+    bool hit_anything = false;
+    for (auto i = begin; i < end; i++) {
+        if (objects[i].hit(r, t_min, t_max, rec)) {
+            hit_anything = true;
+            t_max = rec.t;
+            hit.deferred = false;
+        }
+    }
+    return hit_anything;
+}
+
+template <typename T>
+inline void PrimitiveStore::hit_packet_each(
+    const std::vector<T> &objects, uint32_t begin, uint32_t end,
+    RayPacket8 &packet, double t_min, HitRecord recs[RayPacket8::size], uint32_t &hit_mask
+) {
+    for (auto i = begin; i < end; i++) {
+        objects[i].hit_packet(packet, t_min, recs, hit_mask);
+    }
+}
+
+inline bool PrimitiveStore::hit_spheres(
+    uint32_t begin, uint32_t end, const Ray &r, double t_min, double &t_max, LeafHit &hit
+) const {
+    RT_STAT_ADD(sphere_tests, end - begin);
+    const double ox = r.origin().x(), oy = r.origin().y(), oz = r.origin().z();
+    const double dx = r.direction().x(), dy = r.direction().y(), dz = r.direction().z();
+    const auto a = dx * dx + dy * dy + dz * dz;
+
+    int best = -1;
+    for (auto start = begin; start < end; start += batch_size) {
+        auto count = std::min<uint32_t>(batch_size, end - start);
+        const double *cx = sphere_geometry.cx.data() + start;
+        const double *cy = sphere_geometry.cy.data() + start;
+        const double *cz = sphere_geometry.cz.data() + start;
+        const double *radius = sphere_geometry.radius.data() + start;
+        double roots[batch_size];
+
+        // The arithmetic of Sphere::hit, without its early exits. A root
+        // beyond the batch's t_max is rejected there just the same, and
+        // the far root of a sphere behind a closer hit is farther still.
+        for (uint32_t k = 0; k < count; k++) {
+            auto ocx = ox - cx[k];
+            auto ocy = oy - cy[k];
+            auto ocz = oz - cz[k];
+            auto half_b = ocx * dx + ocy * dy + ocz * dz;
+            auto c = (ocx * ocx + ocy * ocy + ocz * ocz) - radius[k] * radius[k];
+
+            auto discriminant = half_b * half_b - a * c;
+            auto sqrtd = sqrt(discriminant < 0 ? 0.0 : discriminant);
+
+            auto near = (-half_b - sqrtd) / a;
+            auto far = (-half_b + sqrtd) / a;
+            bool near_ok = !(near <= t_min || t_max < near);
+            bool far_ok = !(far <= t_min || t_max < far);
+
+            roots[k] = discriminant < 0 ? INF : near_ok ? near : far_ok ? far : INF;
+        }
+
+        // <= keeps the later of two equal roots, as hit() in order would.
+        for (uint32_t k = 0; k < count; k++) {
+            if (roots[k] != INF && roots[k] <= t_max) {
+                t_max = roots[k];
+                best = static_cast<int>(start + k);
+            }
+        }
+    }
+
+    if (best < 0) {
+        return false;
+    }
+
+    hit.deferred = true;
+    hit.id = make_primitive_id(PrimitiveKind::Sphere, static_cast<uint32_t>(best));
+    return true;
+}
+
+template <int Axis>
+inline bool PrimitiveStore::hit_rects(
+    uint32_t begin, uint32_t end, const Ray &r, double t_min, double &t_max, LeafHit &hit
+) const {
+    const int u_axis = Axis == 0 ? 1 : 0;
+    const int v_axis = Axis == 2 ? 1 : 2;
+    const auto kind = Axis == 2 ? PrimitiveKind::XYRect : Axis == 1 ? PrimitiveKind::XZRect : PrimitiveKind::YZRect;
+    const auto &g = rect_geometry[Axis];
+
+    RT_STAT_ADD(rect_tests, end - begin);
+    const double o[3] = { r.origin()[0], r.origin()[1], r.origin()[2] };
+    const double d[3] = { r.direction()[0], r.direction()[1], r.direction()[2] };
+
+    int best = -1;
+    for (auto start = begin; start < end; start += batch_size) {
+        auto count = std::min<uint32_t>(batch_size, end - start);
+        const double *u0 = g.u0.data() + start;
+        const double *u1 = g.u1.data() + start;
+        const double *v0 = g.v0.data() + start;
+        const double *v1 = g.v1.data() + start;
+        const double *k = g.k.data() + start;
+        double ts[batch_size];
+
+        for (uint32_t j = 0; j < count; j++) {
+            auto t = (k[j] - o[Axis]) / d[Axis];
+            auto u = o[u_axis] + t * d[u_axis];
+            auto v = o[v_axis] + t * d[v_axis];
+
+            bool inside = !(t <= t_min || t > t_max) && !(u < u0[j] || u > u1[j] || v < v0[j] || v > v1[j]);
+            ts[j] = inside ? t : INF;
+        }
+
+        for (uint32_t j = 0; j < count; j++) {
+            if (ts[j] != INF && ts[j] <= t_max) {
+                t_max = ts[j];
+                best = static_cast<int>(start + j);
+            }
+        }
+    }
+
+    if (best < 0) {
+        return false;
+    }
+
+    hit.deferred = true;
+    hit.id = make_primitive_id(kind, static_cast<uint32_t>(best));
+    return true;
+}
+
+inline bool PrimitiveStore::hit_boxes(
+    uint32_t begin, uint32_t end, const Ray &r, double t_min, double &t_max, LeafHit &hit
+) const {
+    RT_STAT_ADD(box_tests, end - begin);
+    const double o[3] = { r.origin()[0], r.origin()[1], r.origin()[2] };
+    const double d[3] = { r.direction()[0], r.direction()[1], r.direction()[2] };
+
+    // The slab test picks faces with branches, so boxes go one at a time,
+    // straight from the contiguous array.
+    int best = -1;
+    int best_axis = 0;
+    double best_k = 0;
+    for (auto i = begin; i < end; i++) {
+        const auto &b = boxes[i];
+        const double lo[3] = { b.box_min[0], b.box_min[1], b.box_min[2] };
+        const double hi[3] = { b.box_max[0], b.box_max[1], b.box_max[2] };
+
+        double t, k;
+        int axis;
+        if (Box::slab(o, d, lo, hi, t_min, t_max, t, axis, k)) {
+            t_max = t;
+            best = static_cast<int>(i);
+            best_axis = axis;
+            best_k = k;
+        }
+    }
+
+    if (best < 0) {
+        return false;
+    }
+
+    hit.deferred = true;
+    hit.id = make_primitive_id(PrimitiveKind::Box, static_cast<uint32_t>(best));
+    hit.axis = best_axis;
+    hit.k = best_k;
+    return true;
+}
+
+#endif
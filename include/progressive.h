@@ -0,0 +1,221 @@
+#ifndef PROGRESSIVE_H
+#define PROGRESSIVE_H
+
+#include "rtweekend.h"
+
+#include "image.h"
+#include "scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+/// @brief Knobs of a progressive render. With `pass_samples` equal to
+///        `max_samples` and no threshold it degenerates into a plain
+///        fixed-sample render.
+struct ProgressiveSettings {
+    int pass_samples = 8;       ///< Samples every unfinished pixel gets per pass
+    int max_samples = 100;      ///< Per-pixel cap
+    int min_passes = 4;         ///< Passes before a tile may count as converged
+    double threshold = 0;       ///< Relative error that stops a tile; 0 disables
+    double time_budget = 0;     ///< Seconds after which no new pass starts; 0 disables
+};
+
+/// @brief Running sums of one pixel. The color sum is single precision; the
+///        luminance moments are of the per-pass means, which is what the
+///        error estimate is built from.
+struct PixelAccumulator {
+    float sum[3];
+    float pass_mean;
+    float pass_mean_sq;
+    uint32_t samples;
+    uint32_t passes;
+};
+
+/// @brief Renders an image in passes, each adding `pass_samples` samples to
+///        every tile that is not done yet, and accumulates them into a float
+///        framebuffer. A tile is done once it hits `max_samples` or, with a
+///        threshold set, once its error estimate falls below the threshold.
+///        The estimate is the RMS over the tile of each pixel's standard
+///        error divided by the square root of its mean, which approximates
+///        the absolute error left after the gamma applied on output. It is
+///        taken from the spread of the per-pass means (batch means), so it
+///        works with any integrator that can render a range of samples.
+class ProgressiveRenderer {
+    private:
+        int width;
+        int height;
+        ProgressiveSettings settings;
+
+        std::vector<PixelAccumulator> pixels;
+        std::vector<Color> pass_buffer;
+        std::vector<uint8_t> tile_done;
+        std::vector<float> tile_error;
+
+        int passes_run = 0;
+        double elapsed_ms = 0;
+
+    public:
+        ProgressiveRenderer(
+            __F_IN__ int width,
+            __F_IN__ int height,
+            __F_IN__ const ProgressiveSettings &settings
+        ) : width(width), height(height), settings(settings),
+            pixels(static_cast<size_t>(width) * height, PixelAccumulator{}),
+            pass_buffer(static_cast<size_t>(width) * height) {}
+
+        /// @brief Runs passes until every tile is done or the time budget is
+        ///        spent.
+        /// @param scheduler Schedules the tiles of every pass
+        /// @param render_samples Called as render_samples(const Tile &, int thread_id,
+        ///        int first_sample, int sample_count, Color *out); adds the summed
+        ///        radiance of samples [first_sample, first_sample + sample_count)
+        ///        of each pixel into out[j * width + i]
+        template <typename F>
+        void render(__F_INOUT__ TileScheduler &scheduler, __F_IN__ F &&render_samples);
+
+        int pixel_samples(int i, int j) const {
+            return static_cast<int>(pixels[static_cast<size_t>(j) * width + i].samples);
+        }
+
+        /// @brief Averages the samples of every pixel into an image.
+        Image resolve() const;
+
+        /// @brief Prints passes run, mean samples per pixel and converged tiles.
+        void report(__F_INOUT__ std::ostream &out) const;
+
+    private:
+        void accumulate(const Tile &tile, int sample_count);
+        static float luminance(const Color &c) {
+            return static_cast<float>(0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z());
+        }
+};
+
+template <typename F>
+void ProgressiveRenderer::render(TileScheduler &scheduler, F &&render_samples) {
+    const auto &tiles = scheduler.get_tiles();
+    tile_done.assign(tiles.size(), 0);
+    tile_error.assign(tiles.size(), 0);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<int> active;
+
+    while (true) {
+        active.clear();
+        for (size_t t = 0; t < tiles.size(); t++) {
+            if (!tile_done[t]) {
+                active.push_back(static_cast<int>(t));
+            }
+        }
+        if (active.empty()) {
+            break;
+        }
+
+        scheduler.run(active, [&](const Tile &tile, int thread_id) {
+            // Every pixel of a tile has seen the same number of samples.
+            int first = static_cast<int>(pixels[static_cast<size_t>(tile.y0) * width + tile.x0].samples);
+            int count = std::min(settings.pass_samples, settings.max_samples - first);
+
+            for (int j = tile.y0; j < tile.y1; j++) {
+                auto row = pass_buffer.begin() + static_cast<size_t>(j) * width;
+                std::fill(row + tile.x0, row + tile.x1, Color(0, 0, 0));
+            }
+
+            render_samples(tile, thread_id, first, count, pass_buffer.data());
+            accumulate(tile, count);
+        });
+
+        passes_run++;
+        elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        if (scheduler.show_progress) {
+            std::cerr << "\rPass " << passes_run << ": " << active.size() << " tiles, "
+                      << elapsed_ms / 1000.0 << "s " << std::flush;
+        }
+
+        if (settings.time_budget > 0 && elapsed_ms >= settings.time_budget * 1000.0) {
+            break;
+        }
+    }
+    if (scheduler.show_progress) {
+        std::cerr << '\n';
+    }
+}
+
+void ProgressiveRenderer::accumulate(const Tile &tile, int sample_count) {
+    float error_sq_sum = 0;
+    uint32_t samples = 0;
+    uint32_t passes = 0;
+
+    for (int j = tile.y0; j < tile.y1; j++) {
+        for (int i = tile.x0; i < tile.x1; i++) {
+            auto index = static_cast<size_t>(j) * width + i;
+            const Color &c = pass_buffer[index];
+            auto &p = pixels[index];
+
+            p.sum[0] += static_cast<float>(c.x());
+            p.sum[1] += static_cast<float>(c.y());
+            p.sum[2] += static_cast<float>(c.z());
+
+            float mean = luminance(c) / sample_count;
+            p.pass_mean += mean;
+            p.pass_mean_sq += mean * mean;
+            p.samples += sample_count;
+            p.passes++;
+
+            // Variance of the mean from the spread of the pass means. The
+            // floor keeps near-black pixels from demanding endless samples.
+            float n = static_cast<float>(p.passes);
+            float m = p.pass_mean / n;
+            float var_of_mean = std::max(0.0f, p.pass_mean_sq / n - m * m) / std::max(1.0f, n - 1);
+            error_sq_sum += var_of_mean / std::max(m, 1e-2f);
+
+            samples = p.samples;
+            passes = p.passes;
+        }
+    }
+
+    // A tile is judged by the RMS of its pixels' errors, so a few
+    // fireflies alone do not keep it rendering.
+    float error = std::sqrt(error_sq_sum / ((tile.x1 - tile.x0) * (tile.y1 - tile.y0)));
+    tile_error[tile.index] = error;
+    bool converged = settings.threshold > 0
+        && static_cast<int>(passes) >= settings.min_passes
+        && error < settings.threshold;
+    tile_done[tile.index] = converged || static_cast<int>(samples) >= settings.max_samples;
+}
+
+Image ProgressiveRenderer::resolve() const {
+    Image image(width, height);
+    for (int j = 0; j < height; j++) {
+        for (int i = 0; i < width; i++) {
+            const auto &p = pixels[static_cast<size_t>(j) * width + i];
+            double scale = p.samples > 0 ? 1.0 / p.samples : 0.0;
+            image.set(i, height - 1 - j, scale * Color(p.sum[0], p.sum[1], p.sum[2]));
+        }
+    }
+    return image;
+}
+
+void ProgressiveRenderer::report(std::ostream &out) const {
+    double total_samples = 0;
+    for (const auto &p : pixels) {
+        total_samples += p.samples;
+    }
+
+    size_t converged = 0;
+    for (size_t t = 0; t < tile_done.size(); t++) {
+        if (tile_done[t] && tile_error[t] < settings.threshold) {
+            converged++;
+        }
+    }
+
+    out << "Progressive: " << passes_run << " passes in " << elapsed_ms / 1000.0 << "s, "
+        << total_samples / pixels.size() << " spp on average, "
+        << converged << " of " << tile_done.size() << " tiles converged\n";
+}
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "ray.h"
+#include "rng.h"
+
+#include <cstdint>
+
+/// @brief N rays stored structure-of-arrays so per-lane math in the
+///        primitives' packet tests runs as straight loops the compiler can
+///        vectorize. `t_max` is the closest hit found so far for each lane
+///        and `active` masks out lanes that should be skipped. Inactive
+///        lanes hold zeros, so the straight loops never read garbage.
+template <int N>
+struct RayPacket {
+    static const int size = N;
+
+    double org_x[N], org_y[N], org_z[N];
+    double dir_x[N], dir_y[N], dir_z[N];
+    double time[N];
+    double t_max[N];
+    uint32_t active;
+
+    /// Each lane's own generator, when the caller keeps one per lane.
+    /// Primitives that draw random numbers while intersecting, such as
+    /// ConstantMedium, draw lane k's from rngs[k], so a packet trace draws
+    /// what tracing the lanes one at a time would.
+    Pcg32 *rngs;
+
+    RayPacket()
+        : org_x{}, org_y{}, org_z{}, dir_x{}, dir_y{}, dir_z{}, time{}, t_max{}, active(0), rngs(nullptr) {}
+
+    void set(int k, const Ray &r, double t_max_k) {
+        org_x[k] = r.origin().x();
+        org_y[k] = r.origin().y();
+        org_z[k] = r.origin().z();
+        dir_x[k] = r.direction().x();
+        dir_y[k] = r.direction().y();
+        dir_z[k] = r.direction().z();
+        time[k] = r.time();
+        t_max[k] = t_max_k;
+        active |= 1u << k;
+    }
+
+    Ray ray(int k) const {
+        return Ray(Point3(org_x[k], org_y[k], org_z[k]), Vec3(dir_x[k], dir_y[k], dir_z[k]), time[k]);
+    }
+
+    bool is_active(int k) const { return (active >> k) & 1u; }
+
+    int active_count() const {
+        int count = 0;
+        for (uint32_t m = active; m; m &= m - 1) {
+            count++;
+        }
+        return count;
+    }
+};
+
+using RayPacket8 = RayPacket<8>;
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>
+
+/// @brief PCG32 (XSH-RR variant), a small and fast generator with 64 bits of
+///        state and selectable streams. See https://www.pcg-random.org/
+class Pcg32 {
+    private:
+        uint64_t state;
+        uint64_t inc;
+
+    public:
+        Pcg32() : Pcg32(0x853c49e6748fea9bULL, 0xda3e39cb94b95bdbULL) {}
+        Pcg32(uint64_t seed, uint64_t stream) { reseed(seed, stream); }
+
+        /// @brief Restarts the generator at a given seed on a given stream.
+        /// @param seed Starting point in the sequence
+        /// @param stream Which of the 2^63 sequences to use
+        void reseed(uint64_t seed, uint64_t stream) {
+            state = 0;
+            inc = (stream << 1u) | 1u;
+            next_u32();
+            state += seed;
+            next_u32();
+        }
+
+        uint32_t next_u32() {
+            uint64_t old = state;
+            state = old * 6364136223846793005ULL + inc;
+            auto xorshifted = static_cast<uint32_t>(((old >> 18u) ^ old) >> 27u);
+            auto rot = static_cast<uint32_t>(old >> 59u);
+            return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+        }
+
+        /// @brief Returns a random double in [0, 1) with 53 bits of precision.
+        /// @return A random double
+        double next_double() {
+            uint64_t hi = next_u32() >> 5;
+            uint64_t lo = next_u32() >> 6;
+            return static_cast<double>((hi << 26) | lo) * (1.0 / 9007199254740992.0);
+        }
+};
+
+/// @brief SplitMix64 finalizer, used to turn structured keys into seeds.
+inline uint64_t mix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/// @brief Seed shared by every thread; change it to get a different but
+///        still reproducible render.
+inline uint64_t &rng_global_seed() {
+    static uint64_t seed = 0;
+    return seed;
+}
+
+/// @brief The calling thread's generator. Each thread has its own state, so
+///        drawing numbers never touches memory another thread writes.
+inline Pcg32 &thread_rng() {
+    thread_local Pcg32 rng;
+    return rng;
+}
+
+/// @brief Re-keys the calling thread's generator for one camera sample.
+///        Every random number a path draws then depends only on
+///        (seed, pixel, sample) and not on which thread traced it or in
+///        which order, which makes renders identical for any thread count.
+/// @param pixel Linear index of the pixel
+/// @param sample Index of the sample within the pixel
+inline void seed_thread_rng(uint64_t pixel, uint64_t sample) {
+    uint64_t key = mix64(rng_global_seed() ^ mix64(pixel));
+    thread_rng().reseed(mix64(key ^ sample), key);
+}
+
+#endif
@@ -7,6 +7,9 @@
 #include <memory>
 #include <random>
 
+#include "rng.h"
+#include "stats.h"
+
 // Defines
 #define __F_IN__
 #define __F_IN_OPT__
@@ -46,12 +49,10 @@ inline double random_double(double min, double max) {
     return min + (max - min) * random_double();
 }
 
-/// @brief  Returns a random double in [0, 1).
+/// @brief  Returns a random double in [0, 1) from the calling thread's generator.
 /// @return A random double
 inline double random_double2() {
-    static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-    static std::mt19937 generator;
-    return distribution(generator);
+    return thread_rng().next_double();
 }
 
 /// @brief Returns a random double in [min, max)
@@ -0,0 +1,395 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include "rtweekend.h"
+
+#include "instance.h"
+#include "mesh_cache.h"
+#include "mesh_loader.h"
+#include "scenes.h"
+#include "triangle_mesh.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/// @brief Loads an OBJ, PLY or mesh cache (.rtmesh) as a TriangleMesh and
+///        prints how long it took. OBJ and PLY meshes are fitted with
+///        MeshData::fit_to when `fit_size` is positive; a cache is used as
+///        stored, since it already holds a placed mesh and its BVH.
+/// @param cache_path If not empty, a mesh cache of the result is written there
+/// @return nullptr, after printing why, on failure
+inline shared_ptr<TriangleMesh> load_triangle_mesh(
+    __F_IN__ const std::string &path,
+    __F_IN__ shared_ptr<Material> m,
+    __F_IN__ const Point3 &fit_center,
+    __F_IN__ double fit_size,
+    __F_IN__ const std::string &cache_path = ""
+) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    shared_ptr<TriangleMesh> mesh;
+    if (is_mesh_cache_path(path)) {
+        mesh = load_mesh_cache(path, m);
+    } else {
+        MeshData data;
+        if (load_mesh(path, data)) {
+            if (fit_size > 0) {
+                data.fit_to(fit_center, fit_size);
+            }
+            mesh = make_shared<TriangleMesh>(std::move(data), m);
+        }
+    }
+    if (!mesh) {
+        return nullptr;
+    }
+
+    auto ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cerr << "Mesh " << path << ": " << ms << "ms to load, BVH " << mesh->build_stats << ", "
+              << static_cast<double>(mesh->memory_bytes()) / std::max<size_t>(1, mesh->triangle_count()) << " bytes/triangle\n";
+
+    if (!cache_path.empty()) {
+        if (!write_mesh_cache(*mesh, cache_path)) {
+            std::cerr << "ERROR: Could not write mesh cache '" << cache_path << "'.\n";
+            return nullptr;
+        }
+        std::cerr << "Mesh cache written to " << cache_path << '\n';
+    }
+    return mesh;
+}
+
+/// @brief Reads a scene description. The format is line based; `#` starts
+///        a comment and words are separated by whitespace. Relative paths
+///        are relative to the scene file.
+///
+///     scene NAME                  start from a built-in scene
+///     camera [lookfrom X Y Z] [lookat X Y Z] [up X Y Z] [vfov DEG]
+///            [aperture A] [focus DIST] [time T0 T1]
+///     render [width N] [aspect A] [spp N] [depth N]
+///     background R G B
+///
+///     material NAME lambertian R G B
+///     material NAME checker R G B R G B       (Lambertian)
+///     material NAME noise SCALE               (Lambertian)
+///     material NAME image PATH                (Lambertian)
+///     material NAME metal R G B FUZZ
+///     material NAME dielectric IOR
+///     material NAME diffuse_light R G B
+///
+///     sphere X Y Z RADIUS MAT
+///     moving_sphere X0 Y0 Z0 X1 Y1 Z1 T0 T1 RADIUS MAT
+///     xy_rect X0 X1 Y0 Y1 Z MAT
+///     xz_rect X0 X1 Z0 Z1 Y MAT
+///     yz_rect Y0 Y1 Z0 Z1 X MAT
+///     box X0 Y0 Z0 X1 Y1 Z1 MAT
+///     mesh PATH MAT               OBJ, PLY or mesh cache; repeats of the same
+///                                 mesh, material and fit share one copy
+///
+/// An object line may end in modifiers, applied left to right:
+///
+///     fit X Y Z SIZE              (mesh only, before any other) see MeshData::fit_to
+///     rotate_y DEG
+///     translate X Y Z             runs of these become a single Instance
+///     flip                        swap the front face
+///     medium DENSITY R G B        turn the shape into a constant medium
+///     light                       accepted for older files; rects and
+///                                 spheres with a diffuse_light material
+///                                 are sampled as lights anyway, unless
+///                                 rotated or translated
+///
+/// @return false, after printing the offending line, on any error
+bool load_scene_file(__F_IN__ const std::string &path, __F_OUT__ SceneSetup &setup);
+
+namespace scene_file_detail {
+
+/// @brief The words of one line and a read position.
+struct Words {
+    std::vector<std::string> words;
+    size_t next = 0;
+
+    bool done() const { return next >= words.size(); }
+    const std::string &peek() const { return words[next]; }
+
+    bool word(std::string &out) {
+        if (done()) {
+            return false;
+        }
+        out = words[next++];
+        return true;
+    }
+
+    bool number(double &out) {
+        if (done()) {
+            return false;
+        }
+        const std::string &w = words[next];
+        char *end = nullptr;
+        out = std::strtod(w.c_str(), &end);
+        if (end == w.c_str() || *end != '\0') {
+            return false;
+        }
+        next++;
+        return true;
+    }
+
+    bool integer(int &out) {
+        double d;
+        if (!number(d) || d != static_cast<int>(d)) {
+            return false;
+        }
+        out = static_cast<int>(d);
+        return true;
+    }
+
+    bool vec(Vec3 &out) {
+        double x, y, z;
+        if (!number(x) || !number(y) || !number(z)) {
+            return false;
+        }
+        out = Vec3(x, y, z);
+        return true;
+    }
+};
+
+inline std::string resolve_path(const std::string &base_dir, const std::string &path) {
+    if (base_dir.empty() || path.empty() || path[0] == '/' || (path.size() > 1 && path[1] == ':')) {
+        return path;
+    }
+    return base_dir + path;
+}
+
+} // namespace scene_file_detail
+
+bool load_scene_file(const std::string &path, SceneSetup &setup) {
+    using scene_file_detail::Words;
+
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "ERROR: Could not open scene file '" << path << "'.\n";
+        return false;
+    }
+
+    auto slash = path.find_last_of("/\\");
+    std::string base_dir = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+
+    setup = SceneSetup();
+    std::map<std::string, shared_ptr<Material>> materials;
+    std::map<std::string, shared_ptr<Hittable>> meshes;     ///< By path, material and fit
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        auto fail = [&](const std::string &why) {
+            std::cerr << "ERROR: " << path << ':' << line_number << ": " << why << ".\n";
+            return false;
+        };
+
+        Words in;
+        std::istringstream split(line.substr(0, line.find('#')));
+        for (std::string w; split >> w;) {
+            in.words.push_back(w);
+        }
+        if (in.done()) {
+            continue;
+        }
+
+        std::string keyword;
+        in.word(keyword);
+
+        auto material = [&](shared_ptr<Material> &out) {
+            std::string name;
+            if (!in.word(name)) {
+                return false;
+            }
+            auto it = materials.find(name);
+            if (it == materials.end()) {
+                return false;
+            }
+            out = it->second;
+            return true;
+        };
+
+        if (keyword == "scene") {
+            std::string name;
+            if (!in.word(name) || !builtin_scene(name, setup)) {
+                return fail("Unknown built-in scene");
+            }
+        } else if (keyword == "camera") {
+            while (!in.done()) {
+                std::string key;
+                in.word(key);
+                bool ok;
+                if (key == "lookfrom") ok = in.vec(setup.lookfrom);
+                else if (key == "lookat") ok = in.vec(setup.lookat);
+                else if (key == "up") ok = in.vec(setup.vup);
+                else if (key == "vfov") ok = in.number(setup.vfov);
+                else if (key == "aperture") ok = in.number(setup.aperture);
+                else if (key == "focus") ok = in.number(setup.focus_dist);
+                else if (key == "time") ok = in.number(setup.time0) && in.number(setup.time1);
+                else return fail("Unknown camera setting '" + key + "'");
+                if (!ok) {
+                    return fail("Bad value for '" + key + "'");
+                }
+            }
+        } else if (keyword == "render") {
+            while (!in.done()) {
+                std::string key;
+                in.word(key);
+                bool ok;
+                if (key == "width") ok = in.integer(setup.image_width) && setup.image_width > 0;
+                else if (key == "aspect") ok = in.number(setup.aspect_ratio) && setup.aspect_ratio > 0;
+                else if (key == "spp") ok = in.integer(setup.samples_per_pixel) && setup.samples_per_pixel > 0;
+                else if (key == "depth") ok = in.integer(setup.max_depth) && setup.max_depth > 0;
+                else return fail("Unknown render setting '" + key + "'");
+                if (!ok) {
+                    return fail("Bad value for '" + key + "'");
+                }
+            }
+        } else if (keyword == "background") {
+            if (!in.vec(setup.background)) {
+                return fail("Expected a color");
+            }
+        } else if (keyword == "material") {
+            std::string name, type;
+            if (!in.word(name) || !in.word(type)) {
+                return fail("Expected a name and a type");
+            }
+
+            shared_ptr<Material> m;
+            Vec3 a, b;
+            double x;
+            std::string file_name;
+            if (type == "lambertian" && in.vec(a)) {
+                m = make_shared<Lambertian>(a);
+            } else if (type == "checker" && in.vec(a) && in.vec(b)) {
+                m = make_shared<Lambertian>(make_shared<CheckerTexture>(a, b));
+            } else if (type == "noise" && in.number(x)) {
+                m = make_shared<Lambertian>(make_shared<NoiseTexture>(x));
+            } else if (type == "image" && in.word(file_name)) {
+                m = make_shared<Lambertian>(make_shared<ImageTexture>(
+                    scene_file_detail::resolve_path(base_dir, file_name).c_str()
+                ));
+            } else if (type == "metal" && in.vec(a) && in.number(x)) {
+                m = make_shared<Metal>(a, x);
+            } else if (type == "dielectric" && in.number(x)) {
+                m = make_shared<Dielectric>(x);
+            } else if (type == "diffuse_light" && in.vec(a)) {
+                m = make_shared<DiffuseLight>(a);
+            } else {
+                return fail("Bad material '" + type + "'");
+            }
+            materials[name] = m;
+        } else {
+            // Objects: the shape itself, then its modifiers.
+            shared_ptr<Hittable> object;
+            shared_ptr<Material> m;
+            Vec3 a, b;
+            double r, k, t0, t1;
+
+            if (keyword == "sphere") {
+                if (!in.vec(a) || !in.number(r) || !material(m)) {
+                    return fail("Expected X Y Z RADIUS MAT");
+                }
+                object = make_shared<Sphere>(a, r, m);
+            } else if (keyword == "moving_sphere") {
+                if (!in.vec(a) || !in.vec(b) || !in.number(t0) || !in.number(t1) || !in.number(r) || !material(m)) {
+                    return fail("Expected X0 Y0 Z0 X1 Y1 Z1 T0 T1 RADIUS MAT");
+                }
+                object = make_shared<MovingSphere>(a, b, t0, t1, r, m);
+            } else if (keyword == "xy_rect" || keyword == "xz_rect" || keyword == "yz_rect") {
+                double u0, u1, v0, v1;
+                if (!in.number(u0) || !in.number(u1) || !in.number(v0) || !in.number(v1) || !in.number(k) || !material(m)) {
+                    return fail("Expected U0 U1 V0 V1 K MAT");
+                }
+                if (keyword == "xy_rect") {
+                    object = make_shared<XYRect>(u0, u1, v0, v1, k, m);
+                } else if (keyword == "xz_rect") {
+                    object = make_shared<XZRect>(u0, u1, v0, v1, k, m);
+                } else {
+                    object = make_shared<YZRect>(u0, u1, v0, v1, k, m);
+                }
+            } else if (keyword == "box") {
+                if (!in.vec(a) || !in.vec(b) || !material(m)) {
+                    return fail("Expected X0 Y0 Z0 X1 Y1 Z1 MAT");
+                }
+                object = make_shared<Box>(a, b, m);
+            } else if (keyword == "mesh") {
+                std::string mesh_path;
+                if (!in.word(mesh_path) || !material(m)) {
+                    return fail("Expected PATH MAT");
+                }
+
+                Vec3 center;
+                double size = 0;
+                if (!in.done() && in.peek() == "fit") {
+                    in.next++;
+                    if (!in.vec(center) || !in.number(size) || size <= 0) {
+                        return fail("Expected fit X Y Z SIZE");
+                    }
+                }
+
+                std::string resolved = scene_file_detail::resolve_path(base_dir, mesh_path);
+                std::ostringstream key;
+                key << resolved << '\n' << m.get() << ' ' << center << ' ' << size;
+                auto &mesh = meshes[key.str()];
+                if (!mesh) {
+                    mesh = load_triangle_mesh(resolved, m, center, size);
+                    if (!mesh) {
+                        return fail("Could not load mesh");
+                    }
+                }
+                object = mesh;
+            } else {
+                return fail("Unknown keyword '" + keyword + "'");
+            }
+
+            // Runs of rotate_y and translate are composed into one transform
+            // and placed as a single Instance.
+            Transform placement;
+            bool placement_pending = false;
+            auto place = [&]() {
+                if (placement_pending) {
+                    object = make_shared<Instance>(object, placement);
+                    placement = Transform();
+                    placement_pending = false;
+                }
+            };
+
+            while (!in.done()) {
+                std::string modifier;
+                in.word(modifier);
+                if (modifier == "rotate_y" && in.number(k)) {
+                    placement = Transform::rotate_y(k) * placement;
+                    placement_pending = true;
+                } else if (modifier == "translate" && in.vec(a)) {
+                    placement = Transform::translate(a) * placement;
+                    placement_pending = true;
+                } else if (modifier == "flip") {
+                    place();
+                    object = make_shared<FlipFace>(object);
+                } else if (modifier == "medium" && in.number(k) && in.vec(a)) {
+                    place();
+                    object = make_shared<ConstantMedium>(object, k, a);
+                } else if (modifier == "light") {
+                    // Lights are found by collect_lights() now.
+                } else {
+                    return fail("Bad modifier '" + modifier + "'");
+                }
+            }
+            place();
+            setup.world.add(object);
+        }
+    }
+
+    // A base scene's lights were collected before the file added to it.
+    setup.lights->clear();
+    collect_lights(setup.world, *setup.lights);
+    return true;
+}
+
+#endif
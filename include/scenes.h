@@ -0,0 +1,430 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "rtweekend.h"
+
+#include "aarect.h"
+#include "box.h"
+#include "constant_medium.h"
+#include "hittable_list.h"
+#include "instance.h"
+#include "lights.h"
+#include "material.h"
+#include "moving_sphere.h"
+#include "sphere.h"
+#include "texture.h"
+#include "wide_bvh.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+HittableList random_scene() {
+    HittableList world;
+
+    auto checker = make_shared<CheckerTexture>(Color(0.2, 0.3, 0.1), Color(0.9, 0.9, 0.9));
+    world.add(make_shared<Sphere>(Point3(0, -1000.0, 0), 1000, make_shared<Lambertian>(checker)));
+
+    for (int a = -11; a < 11; a++){
+        for (int b = -11; b < 11; b++) {
+            auto choose_mat = random_double2();
+            Point3 center(a + 0.9 * random_double2(), 0.2, b + 0.9 * random_double2());
+
+            if ((center - Point3(4, 0.2, 0)).length() > 0.9) {
+                shared_ptr<Material> sphere_material;
+                
+                if (choose_mat < 0.8) {
+                    // diffuse
+                    auto albedo = Color::random() * Color::random();
+                    sphere_material = make_shared<Lambertian>(albedo);
+                    auto center2 = center + Vec3(0, random_double2(0, 0.5), 0);
+                    world.add(make_shared<MovingSphere>(center, center2, 0.0, 1.0, 0.2, sphere_material));
+                } else if (choose_mat < 0.95) {
+                    // metal
+                    auto albedo = Color::random(0.5, 1);
+                    auto fuzz = random_double2(0, 0.5);
+                    sphere_material = make_shared<Metal>(albedo, fuzz);
+                    world.add(make_shared<Sphere>(center, 0.2, sphere_material));
+                } else {
+                    // glass
+                    sphere_material = make_shared<Dielectric>(1.5);
+                    world.add(make_shared<Sphere>(center, 0.2, sphere_material));
+                }
+            }
+        }
+    }
+
+    auto material1 = make_shared<Dielectric>(1.5);
+    world.add(make_shared<Sphere>(Point3(0, 1, 0), 1.0, material1));
+
+    auto material2 = make_shared<Lambertian>(Color(0.4, 0.2, 0.1));
+    world.add(make_shared<Sphere>(Point3(-4, 1, 0), 1.0, material2));
+
+    auto material3 = make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.0);
+    world.add(make_shared<Sphere>(Point3(4, 1, 0), 1.0, material3));
+
+    return world;
+}
+
+HittableList two_spheres() {
+    HittableList objects;
+
+    auto checker = make_shared<CheckerTexture>(Color(0.2, 0.3, 0.1), Color(0.9, 0.9, 0.9));
+
+    objects.add(make_shared<Sphere>(Point3(0, -10, 0), 10, make_shared<Lambertian>(checker)));
+    objects.add(make_shared<Sphere>(Point3(0, 10, 0), 10, make_shared<Lambertian>(checker)));
+
+    return objects;
+}
+
+HittableList two_perlin_spheres() {
+    HittableList objects;
+
+    auto light = make_shared<DiffuseLight>(Color(10, 10, 10));
+    objects.add(make_shared<FlipFace>(make_shared<XZRect>(123, 423, 147, 412, 554, light)));
+
+    auto pertext = make_shared<NoiseTexture>(0.1);
+    objects.add(make_shared<Sphere>(Point3(0, -1000, 0), 1000, make_shared<Lambertian>(pertext)));
+    objects.add(make_shared<Sphere>(Point3(220, 280, 300), 80, make_shared<Lambertian>(pertext)));
+
+    return objects;
+}
+
+HittableList earth() {
+    auto earth_texture = make_shared<ImageTexture>("assets/earthmap.jpg");
+    auto earth_surface = make_shared<Lambertian>(earth_texture);
+    auto globe = make_shared<Sphere>(Point3(0, 0, 0), 2, earth_surface);
+
+    return HittableList(globe);
+}
+
+HittableList simple_light() {
+    HittableList objects;
+
+    auto pertext = make_shared<NoiseTexture>(4);
+    objects.add(make_shared<Sphere>(Point3(0, -1000, 0), 1000, make_shared<Lambertian>(pertext)));
+    objects.add(make_shared<Sphere>(Point3(0, 2, 0), 2, make_shared<Lambertian>(pertext)));
+
+    auto difflight = make_shared<DiffuseLight>(Color(4, 4, 4));
+    // objects.add(make_shared<XYRect>(3, 5, 1, 3, -2, difflight));
+    objects.add(make_shared<Sphere>(Point3(0, 7, 0), 2, difflight));
+
+    return objects;
+}
+
+HittableList cornell_box() {
+    HittableList objects;
+
+    auto red = make_shared<Lambertian>(Color(.65, .05, .05));
+    auto green = make_shared<Lambertian>(Color(.12, .45, .15));
+    auto white = make_shared<Lambertian>(Color(.73, .73, .73));
+    auto light = make_shared<DiffuseLight>(Color(15, 15, 15));
+
+    objects.add(make_shared<YZRect>(0, 555, 0, 555, 555, green));
+    objects.add(make_shared<YZRect>(0, 555, 0, 555, 0, red));
+    objects.add(make_shared<XZRect>(0, 555, 0, 555, 0, white));
+    objects.add(make_shared<FlipFace>(make_shared<XZRect>(213, 343, 227, 332, 554, light)));
+    objects.add(make_shared<XZRect>(0, 555, 0, 555, 555, white));
+    objects.add(make_shared<XYRect>(0, 555, 0, 555, 555, white));
+
+    shared_ptr<Hittable> box1 = make_shared<Box>(Point3(0, 0, 0), Point3(165, 330, 165), white);
+    box1 = make_shared<Instance>(box1, Transform::translate(Vec3(265, 0, 295)) * Transform::rotate_y(15));
+    objects.add(box1);
+
+    shared_ptr<Hittable> box2 = make_shared<Box>(Point3(0, 0, 0), Point3(165, 165, 165), white);
+    box2 = make_shared<Instance>(box2, Transform::translate(Vec3(130, 0, 65)) * Transform::rotate_y(-18));
+    objects.add(box2);
+
+    return objects;
+}
+
+HittableList cornell_smoke() {
+    HittableList objects;
+
+    auto red = make_shared<Lambertian>(Color(.65, .05, .05));
+    auto green = make_shared<Lambertian>(Color(.12, .45, .15));
+    auto white = make_shared<Lambertian>(Color(.73, .73, .73));
+    auto light = make_shared<DiffuseLight>(Color(7, 7, 7));
+
+    objects.add(make_shared<YZRect>(0, 555, 0, 555, 555, green));
+    objects.add(make_shared<YZRect>(0, 555, 0, 555, 0, red));
+    objects.add(make_shared<FlipFace>(make_shared<XZRect>(113, 443, 127, 432, 554, light)));
+    objects.add(make_shared<XZRect>(0, 555, 0, 555, 0, white));
+    objects.add(make_shared<XZRect>(0, 555, 0, 555, 555, white));
+    objects.add(make_shared<XYRect>(0, 555, 0, 555, 555, white));
+
+    shared_ptr<Hittable> box1 = make_shared<Box>(Point3(0, 0, 0), Point3(165, 330, 165), white);
+    box1 = make_shared<Instance>(box1, Transform::translate(Vec3(265, 0, 295)) * Transform::rotate_y(15));
+
+    shared_ptr<Hittable> box2 = make_shared<Box>(Point3(0, 0, 0), Point3(165, 165, 165), white);
+    box2 = make_shared<Instance>(box2, Transform::translate(Vec3(130, 0, 65)) * Transform::rotate_y(-18));
+
+    objects.add(make_shared<ConstantMedium>(box1, 0.01, Color(0,0,0)));
+    objects.add(make_shared<ConstantMedium>(box2, 0.01, Color(1,1,1)));
+    return objects;
+}
+
+/// @param inner_bvhs The nested BVHs' build stats are appended here
+HittableList final_scene(__F_OUT__ std::vector<NamedBVHStats> &inner_bvhs) {
+    HittableList boxes1;
+    auto ground = make_shared<Lambertian>(Color(0.48, 0.83, 0.53));
+
+    const int boxes_per_side = 20;
+
+    for (int i = 0; i < boxes_per_side; i++) {
+        for (int j = 0; j < boxes_per_side; j++) {
+            auto w = 100.0;
+            auto x0 = -1000.0 + i * w;
+            auto z0 = -1000.0 + j * w;
+            auto y0 = 0.0;
+            auto x1 = x0 + w;
+            auto y1 = random_double2(1, 101);
+            auto z1 = z0 + w;
+
+            boxes1.add(make_shared<Box>(Point3(x0, y0, z0), Point3(x1, y1, z1), ground));
+        }
+    }
+
+    HittableList objects;
+
+    auto ground_bvh = make_shared<WideBVH>(boxes1, 0, 1);
+    inner_bvhs.push_back(NamedBVHStats{ "Ground", ground_bvh->build_stats });
+    objects.add(ground_bvh);
+
+    auto light = make_shared<DiffuseLight>(Color(7, 7, 7));
+    objects.add(make_shared<FlipFace>(make_shared<XZRect>(123, 423, 147, 412, 554, light)));
+
+    auto center1 = Point3(400, 400, 200);
+    auto center2 = center1 + Vec3(30, 0, 0);
+
+    auto moving_sphere_material = make_shared<Lambertian>(Color(0.7, 0.3, 0.1));
+    objects.add(make_shared<MovingSphere>(center1, center2, 0, 1, 50, moving_sphere_material));
+
+    objects.add(make_shared<Sphere>(Point3(260, 150, 45), 50, make_shared<Dielectric>(1.5)));
+
+    objects.add(make_shared<Sphere>(Point3(0, 150, 145), 50, make_shared<Metal>(Color(0.8, 0.8, 0.9), 1.0)));
+
+    auto boundary = make_shared<Sphere>(Point3(360, 150, 145), 70, make_shared<Dielectric>(1.5));
+    objects.add(boundary);
+    objects.add(make_shared<ConstantMedium>(boundary, 0.2, Color(0.2, 0.4, 0.9)));
+    boundary = make_shared<Sphere>(Point3(0, 0, 0), 5000, make_shared<Dielectric>(1.5));
+    objects.add(make_shared<ConstantMedium>(boundary, .0001, Color(1, 1, 1)));
+
+    auto emat = make_shared<Lambertian>(make_shared<ImageTexture>("assets/earthmap.jpg"));
+    objects.add(make_shared<Sphere>(Point3(400, 200, 400), 100, emat));
+
+    auto pertext = make_shared<NoiseTexture>(0.1);
+    objects.add(make_shared<Sphere>(Point3(220, 280, 300), 80, make_shared<Lambertian>(pertext)));
+
+    HittableList boxes2;
+
+    auto white = make_shared<Lambertian>(Color(.73, .73, .73));
+    int ns = 1000;
+
+    for (int j = 0; j < ns; j++) {
+        boxes2.add(make_shared<Sphere>(Point3::random(0, 165), 10, white));
+    }
+
+    auto cluster = make_shared<WideBVH>(boxes2, 0.0, 1.0);
+    inner_bvhs.push_back(NamedBVHStats{ "Sphere cluster", cluster->build_stats });
+
+    objects.add(make_shared<Instance>(cluster, Transform::translate(Vec3(-100, 270, 395)) * Transform::rotate_y(15)));
+
+    return objects;
+}
+
+/// @param inner_bvhs The ground BVH's build stats are appended here
+HittableList huh(__F_OUT__ std::vector<NamedBVHStats> &inner_bvhs) {
+    HittableList boxes1;
+    auto ground = make_shared<Lambertian>(Color(0.48, 0.83, 0.53));
+
+    const int boxes_per_side = 20;
+
+    for (int i = 0; i < boxes_per_side; i++) {
+        for (int j = 0; j < boxes_per_side; j++) {
+            auto w = 100.0;
+            auto x0 = -1000.0 + i * w;
+            auto z0 = -1000.0 + j * w;
+            auto y0 = 0.0;
+            auto x1 = x0 + w;
+            auto y1 = random_double2(1, 101);
+            auto z1 = z0 + w;
+
+            boxes1.add(make_shared<Box>(Point3(x0, y0, z0), Point3(x1, y1, z1), ground));
+        }
+    }
+
+    HittableList objects;
+
+    auto ground_bvh = make_shared<WideBVH>(boxes1, 0, 1);
+    inner_bvhs.push_back(NamedBVHStats{ "Ground", ground_bvh->build_stats });
+    objects.add(ground_bvh);
+
+    auto light = make_shared<DiffuseLight>(Color(7, 7, 7));
+    objects.add(make_shared<FlipFace>(make_shared<XZRect>(123, 423, 147, 412, 554, light)));
+
+    objects.add(make_shared<Sphere>(Point3(220, 280, 300), 200, make_shared<Dielectric>(1.5)));
+
+    return objects;
+}
+
+/// @brief A floor lit by 1600 small glowing spheres, one in fifty of them
+///        far brighter than the rest, and a ceiling of 100 dim panels,
+///        with a few diffuse spheres in between. For light selection with
+///        many emitters of very different power.
+HittableList many_lights() {
+    HittableList objects;
+
+    auto white = make_shared<Lambertian>(Color(.73, .73, .73));
+    objects.add(make_shared<XZRect>(-500, 500, -500, 500, 0, white));
+
+    const int spheres_per_side = 40;
+    for (int i = 0; i < spheres_per_side; i++) {
+        for (int j = 0; j < spheres_per_side; j++) {
+            Point3 center(-390 + 20 * i + random_double2(-5, 5), random_double2(5, 25), -390 + 20 * j + random_double2(-5, 5));
+            auto strength = random_double2() < 0.02 ? 200.0 : 2.0;
+            auto glow = make_shared<DiffuseLight>(strength * Color::random(0.2, 1));
+            objects.add(make_shared<Sphere>(center, 2, glow));
+        }
+    }
+
+    const int panels_per_side = 10;
+    for (int i = 0; i < panels_per_side; i++) {
+        for (int j = 0; j < panels_per_side; j++) {
+            auto x0 = -450.0 + 90 * i;
+            auto z0 = -450.0 + 90 * j;
+            auto glow = make_shared<DiffuseLight>(0.5 * Color::random(0.5, 1));
+            objects.add(make_shared<FlipFace>(make_shared<XZRect>(x0, x0 + 20, z0, z0 + 20, 300, glow)));
+        }
+    }
+
+    objects.add(make_shared<Sphere>(Point3(-150, 60, 0), 60, make_shared<Lambertian>(Color(.8, .3, .2))));
+    objects.add(make_shared<Sphere>(Point3(0, 60, 100), 60, make_shared<Lambertian>(Color(.2, .5, .8))));
+    objects.add(make_shared<Sphere>(Point3(150, 60, 0), 60, make_shared<Metal>(Color(.8, .8, .8), 0.2)));
+
+    return objects;
+}
+
+/// @brief A scene ready to render: its objects, the emitters to sample
+///        directly (see collect_lights()), the camera, and the render
+///        settings it was composed for. The command line may still
+///        override the latter.
+struct SceneSetup {
+    HittableList world;
+    shared_ptr<HittableList> lights = make_shared<HittableList>();
+
+    Point3 lookfrom = Point3(13, 2, 3);
+    Point3 lookat = Point3(0, 0, 0);
+    Vec3 vup = Vec3(0, 1, 0);
+    double vfov = 40.0;
+    double aperture = 0.0;
+    double focus_dist = 10.0;
+    double time0 = 0.0;
+    double time1 = 1.0;
+
+    double aspect_ratio = 16.0 / 9.0;
+    int image_width = 500;
+    int samples_per_pixel = 500;
+    int max_depth = 50;
+    Color background = Color(0, 0, 0);
+
+    std::vector<NamedBVHStats> inner_bvhs;  ///< BVHs the scene builder nested inside `world`
+};
+
+/// @brief Names accepted by builtin_scene(), in the order they are listed.
+inline const std::vector<std::string> &builtin_scene_names() {
+    static const std::vector<std::string> names = {
+        "random", "two_spheres", "two_perlin_spheres", "earth", "simple_light",
+        "cornell_box", "cornell_smoke", "final_scene", "huh", "many_lights"
+    };
+    return names;
+}
+
+/// @brief Builds one of the scenes above together with the camera and
+///        settings it was made for.
+/// @return false if there is no scene called `name`
+bool builtin_scene(__F_IN__ const std::string &name, __F_OUT__ SceneSetup &setup) {
+    setup = SceneSetup();
+
+    if (name == "random") {
+        setup.world = random_scene();
+        setup.background = Color(0.7, 0.8, 1.0);
+        setup.lookfrom = Point3(13, 2, 3);
+        setup.lookat = Point3(0, 0, 0);
+        setup.vfov = 20.0;
+        setup.aperture = 0.1;
+    } else if (name == "two_spheres") {
+        setup.world = two_spheres();
+        setup.background = Color(0.7, 0.8, 1.0);
+        setup.lookfrom = Point3(13, 2, 3);
+        setup.lookat = Point3(0, 0, 0);
+        setup.vfov = 20.0;
+    } else if (name == "two_perlin_spheres") {
+        setup.world = two_perlin_spheres();
+        setup.background = Color(0, 0, 0);
+        setup.lookfrom = Point3(478, 278, -600);
+        setup.lookat = Point3(278, 278, 0);
+        setup.vfov = 40.0;
+    } else if (name == "earth") {
+        setup.world = earth();
+        setup.lookfrom = Point3(13, 2, 3);
+        setup.background = Color(0.7, 0.8, 1.0);
+        setup.lookat = Point3(0, 0, 0);
+        setup.vfov = 20.0;
+    } else if (name == "simple_light") {
+        setup.world = simple_light();
+        setup.samples_per_pixel = 400;
+        setup.background = Color(0.0, 0.0, 0.0);
+        setup.lookfrom = Point3(26, 3, 6);
+        setup.lookat = Point3(0, 2, 0);
+        setup.vfov = 20.0;
+    } else if (name == "cornell_box") {
+        setup.world = cornell_box();
+        setup.aspect_ratio = 1.0;
+        setup.image_width = 600;
+        setup.samples_per_pixel = 100;
+        setup.background = Color(0, 0, 0);
+        setup.lookfrom = Point3(278, 278, -800);
+        setup.lookat = Point3(278, 278, 0);
+        setup.vfov = 40.0;
+    } else if (name == "cornell_smoke") {
+        setup.world = cornell_smoke();
+        setup.aspect_ratio = 1.0;
+        setup.image_width = 600;
+        setup.samples_per_pixel = 200;
+        setup.lookfrom = Point3(278, 278, -800);
+        setup.lookat = Point3(278, 278, 0);
+        setup.vfov = 40.0;
+    } else if (name == "final_scene") {
+        setup.world = final_scene(setup.inner_bvhs);
+        setup.aspect_ratio = 1.0;
+        setup.image_width = 800;
+        setup.samples_per_pixel = 10000;
+        setup.background = Color(0, 0, 0);
+        setup.lookfrom = Point3(478, 278, -600);
+        setup.lookat = Point3(278, 278, 0);
+        setup.vfov = 40.0;
+    } else if (name == "huh") {
+        setup.world = huh(setup.inner_bvhs);
+        setup.samples_per_pixel = 2000;
+        setup.background = Color(0, 0, 0);
+        setup.lookfrom = Point3(478, 278, -600);
+        setup.lookat = Point3(278, 278, 0);
+        setup.vfov = 40.0;
+    } else if (name == "many_lights") {
+        setup.world = many_lights();
+        setup.samples_per_pixel = 64;
+        setup.max_depth = 20;
+        setup.background = Color(0, 0, 0);
+        setup.lookfrom = Point3(0, 350, -650);
+        setup.lookat = Point3(0, 40, 0);
+        setup.vfov = 40.0;
+    } else {
+        return false;
+    }
+
+    collect_lights(setup.world, *setup.lights);
+    return true;
+}
+
+#endif
@@ -0,0 +1,226 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "rtweekend.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/// @brief A rectangular block of pixels, [x0, x1) x [y0, y1).
+struct Tile {
+    int x0, y0;
+    int x1, y1;
+    int index;
+};
+
+/// @brief How long a single tile took and which worker rendered it.
+struct TileTiming {
+    int index;
+    int thread_id;
+    double ms;
+};
+
+/// @brief Splits an image into tiles and renders them on a set of worker
+///        threads. Every worker owns a deque of tiles; it pops from the back
+///        of its own deque and, once that runs dry, steals from the front of
+///        the others. There is no barrier between rows, a worker only stops
+///        once every deque is empty.
+class TileScheduler {
+    private:
+        struct WorkQueue {
+            std::mutex mutex;
+            std::deque<int> tiles;
+        };
+
+        std::vector<Tile> tiles;
+        std::vector<std::vector<TileTiming>> thread_timings;
+        int n_threads;
+
+    public:
+        /// Print tile progress to stderr while running, and let the
+        /// progressive renderer driving it print its passes.
+        bool show_progress = true;
+
+    public:
+        TileScheduler(
+            __F_IN__ int image_width,
+            __F_IN__ int image_height,
+            __F_IN__ int tile_size,
+            __F_IN__ int threads
+        );
+
+        int thread_count() const { return n_threads; }
+        int tile_count() const { return static_cast<int>(tiles.size()); }
+        const std::vector<Tile> &get_tiles() const { return tiles; }
+
+        /// @brief Renders every tile, blocking until all of them are done.
+        /// @param render_tile Called as render_tile(const Tile &, int thread_id)
+        template <typename F>
+        void run(__F_IN__ F &&render_tile);
+
+        /// @brief Like run(), but only renders the listed tiles.
+        /// @param tile_indices Indices into get_tiles()
+        /// @param render_tile Called as render_tile(const Tile &, int thread_id)
+        template <typename F>
+        void run(__F_IN__ const std::vector<int> &tile_indices, __F_IN__ F &&render_tile);
+
+        /// @brief Timings of the last run, ordered by tile index.
+        std::vector<TileTiming> timings() const;
+
+        /// @brief Prints min/avg/max tile time and the busy time of every worker.
+        void report(__F_INOUT__ std::ostream &out) const;
+
+    private:
+        static bool pop_own(WorkQueue &queue, int &tile) {
+            std::unique_lock<std::mutex> lock(queue.mutex);
+            if (queue.tiles.empty()) {
+                return false;
+            }
+            tile = queue.tiles.back();
+            queue.tiles.pop_back();
+            return true;
+        }
+
+        static bool steal(WorkQueue &queue, int &tile) {
+            std::unique_lock<std::mutex> lock(queue.mutex);
+            if (queue.tiles.empty()) {
+                return false;
+            }
+            tile = queue.tiles.front();
+            queue.tiles.pop_front();
+            return true;
+        }
+};
+
+TileScheduler::TileScheduler(int image_width, int image_height, int tile_size, int threads) {
+    n_threads = std::max(1, threads);
+    tile_size = std::max(1, tile_size);
+
+    // Tiles are laid out top row first so the image fills in the same order
+    // it is written out.
+    for (int y1 = image_height; y1 > 0; y1 -= tile_size) {
+        int y0 = std::max(0, y1 - tile_size);
+        for (int x0 = 0; x0 < image_width; x0 += tile_size) {
+            int x1 = std::min(image_width, x0 + tile_size);
+            tiles.push_back(Tile{x0, y0, x1, y1, static_cast<int>(tiles.size())});
+        }
+    }
+}
+
+template <typename F>
+void TileScheduler::run(F &&render_tile) {
+    std::vector<int> all(tiles.size());
+    for (size_t t = 0; t < all.size(); t++) {
+        all[t] = static_cast<int>(t);
+    }
+    run(all, std::forward<F>(render_tile));
+}
+
+template <typename F>
+void TileScheduler::run(const std::vector<int> &tile_indices, F &&render_tile) {
+    std::vector<WorkQueue> queues(n_threads);
+    thread_timings.assign(n_threads, std::vector<TileTiming>());
+
+    // Hand out contiguous runs of tiles so neighbouring tiles (and their
+    // cache footprint) start on the same worker. Workers pop from the back,
+    // thieves take from the front, so they rarely touch the same end.
+    int n_tiles = static_cast<int>(tile_indices.size());
+    for (int t = 0; t < n_tiles; t++) {
+        queues[static_cast<size_t>(t) * n_threads / n_tiles].tiles.push_back(tile_indices[t]);
+    }
+
+    std::atomic<int> tiles_done(0);
+    auto last_progress = std::chrono::high_resolution_clock::now();
+
+    auto worker = [&](int thread_id) {
+        auto &own = queues[thread_id];
+        auto &timing = thread_timings[thread_id];
+        int tile;
+
+        while (true) {
+            bool found = pop_own(own, tile);
+            for (int k = 1; !found && k < n_threads; k++) {
+                found = steal(queues[(thread_id + k) % n_threads], tile);
+            }
+            if (!found) {
+                return;
+            }
+
+            auto start = std::chrono::high_resolution_clock::now();
+            render_tile(tiles[tile], thread_id);
+            auto stop = std::chrono::high_resolution_clock::now();
+
+            timing.push_back(TileTiming{
+                tile, thread_id, std::chrono::duration<double, std::milli>(stop - start).count()
+            });
+
+            // Only worker 0 reports, at most every 100ms; flushing stderr
+            // per tile costs more than small tiles do at 4K.
+            int done = tiles_done.fetch_add(1) + 1;
+            if (show_progress && thread_id == 0 && (stop - last_progress > std::chrono::milliseconds(100) || done == n_tiles)) {
+                std::cerr << "\rTiles remaining: " << n_tiles - done << ' ' << std::flush;
+                last_progress = stop;
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int t = 1; t < n_threads; t++) {
+        workers.emplace_back(worker, t);
+    }
+    worker(0);
+
+    for (auto &w : workers) {
+        w.join();
+    }
+}
+
+std::vector<TileTiming> TileScheduler::timings() const {
+    std::vector<TileTiming> all;
+    for (const auto &per_thread : thread_timings) {
+        all.insert(all.end(), per_thread.begin(), per_thread.end());
+    }
+
+    std::sort(all.begin(), all.end(), [](const TileTiming &a, const TileTiming &b) {
+        return a.index < b.index;
+    });
+
+    return all;
+}
+
+void TileScheduler::report(std::ostream &out) const {
+    auto all = timings();
+    if (all.empty()) {
+        return;
+    }
+
+    double min_ms = INF;
+    double max_ms = 0;
+    double sum_ms = 0;
+
+    for (const auto &t : all) {
+        min_ms = std::min(min_ms, t.ms);
+        max_ms = std::max(max_ms, t.ms);
+        sum_ms += t.ms;
+    }
+
+    out << "\nTiles: " << all.size()
+        << " (min " << min_ms << "ms, avg " << sum_ms / all.size() << "ms, max " << max_ms << "ms)\n";
+
+    for (int t = 0; t < n_threads; t++) {
+        double busy = 0;
+        for (const auto &timing : thread_timings[t]) {
+            busy += timing.ms;
+        }
+        out << "Thread " << t << ": " << thread_timings[t].size() << " tiles, " << busy << "ms busy\n";
+    }
+}
+
+#endif
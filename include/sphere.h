@@ -4,7 +4,7 @@
 #include "hittable.h"
 #include "vec3.h"
 
-class Sphere : public Hittable {
+class Sphere final : public Hittable {
     public:
         Point3 center;
         double radius;
@@ -15,10 +15,28 @@ class Sphere : public Hittable {
         Sphere(Point3 cen, double r, shared_ptr<Material> m): center(cen), radius(r), mat_ptr(m) {};
 
         virtual bool hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const override;
+        virtual void hit_packet(
+            RayPacket8 &packet, double t_min, HitRecord recs[RayPacket8::size], uint32_t &hit_mask
+        ) const override;
         virtual double pdf_value(const Point3 &o, const Vec3 &v) const override;
         virtual bool bounding_box(double time0, double time1, Aabb &output_box) const override;
         virtual Vec3 random(const Point3 &o) const override;
 
+        virtual PrimitiveKind kind() const override {
+            return PrimitiveKind::Sphere;
+        }
+
+        /// @brief Fills rec for a hit at distance root, found by hit() or
+        ///        by a BVH leaf testing a run of spheres itself.
+        void set_hit_record(const Ray &r, double root, HitRecord &rec) const {
+            rec.t = root;
+            rec.p = r.at(rec.t);
+            Vec3 outward_normal = (rec.p - center) / radius;
+            rec.set_face_normal(r, outward_normal);
+            get_sphere_uv(outward_normal, rec.u, rec.v);
+            rec.mat_ptr = mat_ptr.get();
+        }
+
     private:
         static void get_sphere_uv(const Point3 &p, double &u, double &v) {
             // p: a point on the sphere of radius 1, centered at the origin.
@@ -41,7 +59,7 @@ class Sphere : public Hittable {
 
 double Sphere::pdf_value(const Point3 &o, const Vec3 &v) const {
     HitRecord rec;
-    if (!this->hit(Ray(o, v), 0.001, INF, rec)) {
+    if (!this->hit(Ray(o, v), 0, INF, rec)) {
         return 0;
     }
 
@@ -52,9 +70,14 @@ double Sphere::pdf_value(const Point3 &o, const Vec3 &v) const {
 }
 
 bool Sphere::hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const {
-    Vec3 oc = r.origin() - center;
-    auto a = r.direction().length_squared();
-    auto half_b = dot(oc, r.direction());
+    RT_STAT_INC(sphere_tests);
+    // Always in double: with a float Real, subtracting a distant center
+    // rounds away the few ulps a spawned ray is offset by, and the ray hits
+    // the sphere it just left (the ground sphere of radius 1000 does this).
+    Vec3T<double> oc = Vec3T<double>(r.origin()) - Vec3T<double>(center);
+    Vec3T<double> dir(r.direction());
+    auto a = dir.length_squared();
+    auto half_b = dot(oc, dir);
     auto c = oc.length_squared() - radius * radius;
 
     auto discriminant = half_b * half_b - a * c;
@@ -64,23 +87,54 @@ bool Sphere::hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const
     auto sqrtd = sqrt(discriminant);
 
     auto root = (-half_b - sqrtd) / a;
-    if (root < t_min || t_max < root) {
+    if (root <= t_min || t_max < root) {
         root = (-half_b + sqrtd) / a;
-        if (root < t_min || t_max < root) {
+        if (root <= t_min || t_max < root) {
             return false;
         }
     }
 
-    rec.t = root;
-    rec.p = r.at(rec.t);
-    Vec3 outward_normal = (rec.p - center) / radius;
-    rec.set_face_normal(r, outward_normal);
-    get_sphere_uv(outward_normal, rec.u, rec.v);
-    rec.mat_ptr = mat_ptr;
+    set_hit_record(r, root, rec);
 
     return true;
 }
 
+void Sphere::hit_packet(RayPacket8 &packet, double t_min, HitRecord recs[RayPacket8::size], uint32_t &hit_mask) const {
+    const int n = RayPacket8::size;
+    double roots[n];
+    RT_STAT_ADD(sphere_tests, packet.active_count());
+
+    // Same arithmetic as hit(), one lane per iteration, no early exits, so
+    // the loop vectorizes. A lane that misses ends up with root = INF.
+    for (int k = 0; k < n; k++) {
+        auto ocx = packet.org_x[k] - center.x();
+        auto ocy = packet.org_y[k] - center.y();
+        auto ocz = packet.org_z[k] - center.z();
+
+        auto a = packet.dir_x[k] * packet.dir_x[k] + packet.dir_y[k] * packet.dir_y[k] + packet.dir_z[k] * packet.dir_z[k];
+        auto half_b = ocx * packet.dir_x[k] + ocy * packet.dir_y[k] + ocz * packet.dir_z[k];
+        auto c = (ocx * ocx + ocy * ocy + ocz * ocz) - radius * radius;
+
+        auto discriminant = half_b * half_b - a * c;
+        auto sqrtd = sqrt(discriminant < 0 ? 0.0 : discriminant);
+
+        auto near = (-half_b - sqrtd) / a;
+        auto far = (-half_b + sqrtd) / a;
+        bool near_ok = !(near <= t_min || packet.t_max[k] < near);
+        bool far_ok = !(far <= t_min || packet.t_max[k] < far);
+
+        roots[k] = discriminant < 0 ? INF : near_ok ? near : far_ok ? far : INF;
+    }
+
+    for (int k = 0; k < n; k++) {
+        if (packet.is_active(k) && roots[k] != INF) {
+            set_hit_record(packet.ray(k), roots[k], recs[k]);
+            packet.t_max[k] = roots[k];
+            hit_mask |= 1u << k;
+        }
+    }
+}
+
 bool Sphere::bounding_box(double time0, double time1, Aabb &output_box) const {
     output_box = Aabb(
         center - Vec3(radius, radius, radius),
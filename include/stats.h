@@ -0,0 +1,107 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+
+/// @brief Every counter kept while rendering, as X(name, description).
+#define RT_STATS_COUNTERS(X) \
+    X(camera_paths, "Camera paths") \
+    X(rays_traced, "Rays traced") \
+    X(shadow_rays, "Shadow rays traced") \
+    X(paths_escaped, "Paths escaped to the background") \
+    X(paths_absorbed, "Paths absorbed (light or non-scattering hit)") \
+    X(paths_depth_limited, "Paths cut off at max depth") \
+    X(bvh_nodes_visited, "BVH nodes visited") \
+    X(aabb_tests, "Ray-box tests") \
+    X(sphere_tests, "Sphere tests") \
+    X(moving_sphere_tests, "MovingSphere tests") \
+    X(rect_tests, "Rect tests") \
+    X(box_tests, "Box tests") \
+    X(triangle_tests, "Triangle tests") \
+    X(medium_tests, "ConstantMedium tests") \
+    X(pdf_evaluations, "PDF evaluations") \
+    X(intersect_ns, "Time in scene intersection (ns)")
+
+/// @brief Counters of one thread, or a sum of them. Only moves when the
+///        program is built with RT_ENABLE_STATS; the RT_STAT_* macros below
+///        compile to nothing otherwise.
+struct RenderStats {
+#define RT_STATS_FIELD(name, description) uint64_t name = 0;
+    RT_STATS_COUNTERS(RT_STATS_FIELD)
+#undef RT_STATS_FIELD
+
+    RenderStats &operator+=(const RenderStats &other) {
+#define RT_STATS_ADD(name, description) name += other.name;
+        RT_STATS_COUNTERS(RT_STATS_ADD)
+#undef RT_STATS_ADD
+        return *this;
+    }
+
+    RenderStats operator-(const RenderStats &other) const {
+        RenderStats diff = *this;
+#define RT_STATS_SUB(name, description) diff.name -= other.name;
+        RT_STATS_COUNTERS(RT_STATS_SUB)
+#undef RT_STATS_SUB
+        return diff;
+    }
+
+    /// @brief Intersection tests against primitives of every kind.
+    uint64_t primitive_tests() const {
+        return sphere_tests + moving_sphere_tests + rect_tests + box_tests + triangle_tests + medium_tests;
+    }
+
+    /// @brief Prints every counter, then a few ratios derived from them.
+    void report(std::ostream &out) const {
+        out << "Render statistics:\n";
+#define RT_STATS_PRINT(name, description) out << "  " << std::left << std::setw(48) << description << std::right << name << '\n';
+        RT_STATS_COUNTERS(RT_STATS_PRINT)
+#undef RT_STATS_PRINT
+
+        auto per = [](uint64_t a, uint64_t b) { return b ? static_cast<double>(a) / b : 0.0; };
+        out << "  Average path length (rays per camera path)     " << per(rays_traced, camera_paths) << '\n'
+            << "  BVH nodes per ray                              " << per(bvh_nodes_visited, rays_traced) << '\n'
+            << "  Ray-box tests per ray                          " << per(aabb_tests, rays_traced) << '\n'
+            << "  Primitive tests per ray                        "
+            << per(primitive_tests(), rays_traced) << '\n'
+            << "  Intersection time per ray (ns)                 " << per(intersect_ns, rays_traced) << '\n';
+    }
+};
+
+/// @brief The calling thread's counters. Each thread only ever writes its
+///        own, so counting needs no atomics; whoever wants totals sums
+///        snapshots taken on each thread.
+inline RenderStats &thread_stats() {
+    thread_local RenderStats stats;
+    return stats;
+}
+
+/// @brief Adds the nanoseconds between construction and destruction to a
+///        counter.
+class ScopedStatTimer {
+    private:
+        uint64_t &counter;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        explicit ScopedStatTimer(uint64_t &counter) : counter(counter), start(std::chrono::steady_clock::now()) {}
+        ~ScopedStatTimer() {
+            counter += static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()
+            );
+        }
+};
+
+#ifdef RT_ENABLE_STATS
+#define RT_STAT_ADD(counter, n) (thread_stats().counter += static_cast<uint64_t>(n))
+#define RT_STAT_INC(counter) (++thread_stats().counter)
+#define RT_STAT_TIMER(counter) ScopedStatTimer rt_stat_timer_##counter(thread_stats().counter)
+#else
+#define RT_STAT_ADD(counter, n) ((void)0)
+#define RT_STAT_INC(counter) ((void)0)
+#define RT_STAT_TIMER(counter) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "rtweekend.h"
+
+#include "aabb.h"
+
+/// @brief An affine transform stored as a 3x4 matrix: the linear part in
+///        the first three columns and the translation in the last. Kept in
+///        double whatever Real is, since instance rays go through it twice.
+class Transform {
+    public:
+        double m[3][4];
+
+    public:
+        /// @brief The identity.
+        Transform() : m{ { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 } } {}
+
+        static Transform translate(__F_IN__ const Vec3 &offset);
+        static Transform scale(__F_IN__ const Vec3 &factors);
+
+        /// @brief Rotations about the axes, counterclockwise looking down
+        ///        the axis towards the origin.
+        static Transform rotate_x(__F_IN__ double degrees);
+        static Transform rotate_y(__F_IN__ double degrees);
+        static Transform rotate_z(__F_IN__ double degrees);
+
+        /// @brief `other` first, then this.
+        Transform operator*(__F_IN__ const Transform &other) const;
+
+        Transform inverse() const;
+
+        Point3 point(__F_IN__ const Point3 &p) const {
+            return Point3(
+                m[0][0] * p[0] + m[0][1] * p[1] + m[0][2] * p[2] + m[0][3],
+                m[1][0] * p[0] + m[1][1] * p[1] + m[1][2] * p[2] + m[1][3],
+                m[2][0] * p[0] + m[2][1] * p[1] + m[2][2] * p[2] + m[2][3]
+            );
+        }
+
+        Vec3 vector(__F_IN__ const Vec3 &v) const {
+            return Vec3(
+                m[0][0] * v[0] + m[0][1] * v[1] + m[0][2] * v[2],
+                m[1][0] * v[0] + m[1][1] * v[1] + m[1][2] * v[2],
+                m[2][0] * v[0] + m[2][1] * v[1] + m[2][2] * v[2]
+            );
+        }
+
+        /// @brief Applies the transpose of the linear part. Called on the
+        ///        inverse of a transform, it carries normals through that
+        ///        transform; the result is not normalized.
+        Vec3 transpose_vector(__F_IN__ const Vec3 &v) const {
+            return Vec3(
+                m[0][0] * v[0] + m[1][0] * v[1] + m[2][0] * v[2],
+                m[0][1] * v[0] + m[1][1] * v[1] + m[2][1] * v[2],
+                m[0][2] * v[0] + m[1][2] * v[1] + m[2][2] * v[2]
+            );
+        }
+
+        /// @brief The box around the eight transformed corners of `box`.
+        Aabb bounds(__F_IN__ const Aabb &box) const;
+};
+
+inline Transform Transform::translate(const Vec3 &offset) {
+    Transform t;
+    t.m[0][3] = offset[0];
+    t.m[1][3] = offset[1];
+    t.m[2][3] = offset[2];
+    return t;
+}
+
+inline Transform Transform::scale(const Vec3 &factors) {
+    Transform t;
+    t.m[0][0] = factors[0];
+    t.m[1][1] = factors[1];
+    t.m[2][2] = factors[2];
+    return t;
+}
+
+inline Transform Transform::rotate_x(double degrees) {
+    auto radians = degrees_to_radians(degrees);
+    auto s = sin(radians);
+    auto c = cos(radians);
+
+    Transform t;
+    t.m[1][1] = c;
+    t.m[1][2] = -s;
+    t.m[2][1] = s;
+    t.m[2][2] = c;
+    return t;
+}
+
+inline Transform Transform::rotate_y(double degrees) {
+    auto radians = degrees_to_radians(degrees);
+    auto s = sin(radians);
+    auto c = cos(radians);
+
+    Transform t;
+    t.m[0][0] = c;
+    t.m[0][2] = s;
+    t.m[2][0] = -s;
+    t.m[2][2] = c;
+    return t;
+}
+
+inline Transform Transform::rotate_z(double degrees) {
+    auto radians = degrees_to_radians(degrees);
+    auto s = sin(radians);
+    auto c = cos(radians);
+
+    Transform t;
+    t.m[0][0] = c;
+    t.m[0][1] = -s;
+    t.m[1][0] = s;
+    t.m[1][1] = c;
+    return t;
+}
+
+inline Transform Transform::operator*(const Transform &other) const {
+    Transform t;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            t.m[i][j] = m[i][0] * other.m[0][j] + m[i][1] * other.m[1][j] + m[i][2] * other.m[2][j];
+        }
+        t.m[i][3] += m[i][3];
+    }
+    return t;
+}
+
+inline Transform Transform::inverse() const {
+    // Adjugate of the linear part over its determinant, then the
+    // translation carried back through it.
+    double a00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+    double a01 = m[0][2] * m[2][1] - m[0][1] * m[2][2];
+    double a02 = m[0][1] * m[1][2] - m[0][2] * m[1][1];
+    double a10 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+    double a11 = m[0][0] * m[2][2] - m[0][2] * m[2][0];
+    double a12 = m[0][2] * m[1][0] - m[0][0] * m[1][2];
+    double a20 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+    double a21 = m[0][1] * m[2][0] - m[0][0] * m[2][1];
+    double a22 = m[0][0] * m[1][1] - m[0][1] * m[1][0];
+    double inv_det = 1.0 / (m[0][0] * a00 + m[0][1] * a10 + m[0][2] * a20);
+
+    Transform t;
+    double adj[3][3] = { { a00, a01, a02 }, { a10, a11, a12 }, { a20, a21, a22 } };
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            t.m[i][j] = adj[i][j] * inv_det;
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        t.m[i][3] = -(t.m[i][0] * m[0][3] + t.m[i][1] * m[1][3] + t.m[i][2] * m[2][3]);
+    }
+    return t;
+}
+
+inline Aabb Transform::bounds(const Aabb &box) const {
+    Point3 min(INF, INF, INF);
+    Point3 max(-INF, -INF, -INF);
+
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 2; j++) {
+            for (int k = 0; k < 2; k++) {
+                Point3 corner = point(Point3(
+                    i ? box.max().x() : box.min().x(),
+                    j ? box.max().y() : box.min().y(),
+                    k ? box.max().z() : box.min().z()
+                ));
+
+                for (int c = 0; c < 3; c++) {
+                    min[c] = fmin(min[c], corner[c]);
+                    max[c] = fmax(max[c], corner[c]);
+                }
+            }
+        }
+    }
+
+    return Aabb(min, max);
+}
+
+#endif
@@ -0,0 +1,401 @@
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include "rtweekend.h"
+
+#include "aabb.h"
+#include "hittable.h"
+#include "linear_bvh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/// @brief Indexed triangle soup with per-vertex attributes kept
+///        structure-of-arrays in single precision. Normals and UVs are
+///        optional; their arrays are either empty or one entry per vertex.
+struct MeshData {
+    std::vector<float> x, y, z;
+    std::vector<float> nx, ny, nz;
+    std::vector<float> u, v;
+    std::vector<uint32_t> indices;  ///< Three per triangle
+
+    size_t vertex_count() const { return x.size(); }
+    size_t triangle_count() const { return indices.size() / 3; }
+    bool has_normals() const { return !nx.empty(); }
+    bool has_uvs() const { return !u.empty(); }
+
+    Point3 position(uint32_t i) const { return Point3(x[i], y[i], z[i]); }
+
+    /// @brief Uniformly scales and moves the mesh so its bounding box is
+    ///        `size` across along its longest axis, centered on `center`
+    ///        in x and z, and resting on `center.y()`.
+    void fit_to(const Point3 &center, double size);
+};
+
+void MeshData::fit_to(const Point3 &center, double size) {
+    if (x.empty()) {
+        return;
+    }
+
+    auto lo_x = *std::min_element(x.begin(), x.end()), hi_x = *std::max_element(x.begin(), x.end());
+    auto lo_y = *std::min_element(y.begin(), y.end()), hi_y = *std::max_element(y.begin(), y.end());
+    auto lo_z = *std::min_element(z.begin(), z.end()), hi_z = *std::max_element(z.begin(), z.end());
+
+    double extent = std::max({ hi_x - lo_x, hi_y - lo_y, hi_z - lo_z });
+    double scale = extent > 0 ? size / extent : 1.0;
+    double mid_x = 0.5 * (lo_x + hi_x);
+    double mid_z = 0.5 * (lo_z + hi_z);
+
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = static_cast<float>((x[i] - mid_x) * scale + center.x());
+        y[i] = static_cast<float>((y[i] - lo_y) * scale + center.y());
+        z[i] = static_cast<float>((z[i] - mid_z) * scale + center.z());
+    }
+}
+
+/// @brief Read-only pointers to the arrays a TriangleMesh traverses. They
+///        point either into the mesh's own MeshData and node vector or into
+///        a mapped mesh cache. Normal and UV pointers are null when absent.
+struct MeshView {
+    const float *x = nullptr, *y = nullptr, *z = nullptr;
+    const float *nx = nullptr, *ny = nullptr, *nz = nullptr;
+    const float *u = nullptr, *v = nullptr;
+    const uint32_t *indices = nullptr;
+    const LinearBVHNode *nodes = nullptr;
+    size_t vertex_count = 0;
+    size_t triangle_count = 0;
+    size_t node_count = 0;
+
+    bool has_normals() const { return nx != nullptr; }
+    bool has_uvs() const { return u != nullptr; }
+
+    Point3 position(uint32_t i) const { return Point3(x[i], y[i], z[i]); }
+};
+
+/// @brief A whole triangle mesh as one Hittable. Triangles are plain
+///        indices into the shared vertex arrays, ordered to match the leaves
+///        of a private BVH, so a triangle costs its 12 bytes of indices plus
+///        its share of vertices and 32-byte BVH nodes instead of a
+///        shared_ptr and a heap object of its own. Intersection uses the
+///        watertight test of Woop, Benthin and Wald (JCGT 2013), so rays
+///        never slip through shared edges.
+class TriangleMesh : public Hittable {
+    public:
+        MeshData mesh;
+        std::vector<LinearBVHNode> nodes;
+        shared_ptr<Material> mat_ptr;
+        Aabb box;
+        BVHBuildStats build_stats;
+
+    private:
+        MeshView view;
+        shared_ptr<const void> storage;   ///< Keeps mapped arrays alive
+
+    public:
+        /// @brief Takes over the mesh and builds its BVH.
+        TriangleMesh(
+            __F_IN__ MeshData data,
+            __F_IN__ shared_ptr<Material> m,
+            __F_IN__ int max_prims_in_leaf = 4,
+            __F_IN__ int threads = 0
+        );
+
+        /// @brief Uses arrays and a BVH that already exist elsewhere, such as
+        ///        in a mapped mesh cache, without copying them.
+        /// @param storage Owner of the memory `view` points into
+        TriangleMesh(
+            __F_IN__ const MeshView &view,
+            __F_IN__ shared_ptr<const void> storage,
+            __F_IN__ shared_ptr<Material> m
+        );
+
+        // The view may point into this object's own vectors.
+        TriangleMesh(const TriangleMesh &) = delete;
+        TriangleMesh &operator=(const TriangleMesh &) = delete;
+
+        virtual bool hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const override;
+        virtual bool bounding_box(double time0, double time1, Aabb &output_box) const override {
+            output_box = box;
+            return view.node_count > 0;
+        }
+
+        const MeshView &arrays() const { return view; }
+        size_t triangle_count() const { return view.triangle_count; }
+
+        /// @brief Bytes held by vertices, indices and BVH nodes.
+        size_t memory_bytes() const;
+
+    private:
+        /// @brief Points the view at `mesh` and `nodes` and derives the box.
+        void set_view_from_owned();
+        void set_box_from_root();
+
+        /// @brief Per-ray setup of the watertight test: the axis the ray
+        ///        mostly travels along becomes z, and a shear maps the ray
+        ///        direction onto it.
+        struct WatertightRay {
+            int kx, ky, kz;
+            double sx, sy, sz;
+            Point3 origin;
+        };
+
+        static WatertightRay setup_ray(const Ray &r);
+
+        bool hit_triangle(
+            const WatertightRay &wr, uint32_t tri, double t_min, double t_max,
+            double &t, double &b0, double &b1, double &b2
+        ) const;
+};
+
+TriangleMesh::TriangleMesh(MeshData data, shared_ptr<Material> m, int max_prims_in_leaf, int threads)
+    : mesh(std::move(data)), mat_ptr(m) {
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    size_t n = mesh.triangle_count();
+    std::vector<Aabb> boxes(n);
+    for (size_t t = 0; t < n; t++) {
+        auto a = mesh.position(mesh.indices[3 * t]);
+        auto b = mesh.position(mesh.indices[3 * t + 1]);
+        auto c = mesh.position(mesh.indices[3 * t + 2]);
+        boxes[t] = Aabb(
+            Point3(fmin(a.x(), fmin(b.x(), c.x())), fmin(a.y(), fmin(b.y(), c.y())), fmin(a.z(), fmin(b.z(), c.z()))),
+            Point3(fmax(a.x(), fmax(b.x(), c.x())), fmax(a.y(), fmax(b.y(), c.y())), fmax(a.z(), fmax(b.z(), c.z())))
+        );
+    }
+
+    BVHBuilder builder(std::move(boxes), max_prims_in_leaf, threads);
+    nodes = std::move(builder.nodes);
+
+    std::vector<uint32_t> sorted(mesh.indices.size());
+    for (size_t t = 0; t < n; t++) {
+        std::copy_n(&mesh.indices[3 * static_cast<size_t>(builder.order[t])], 3, &sorted[3 * t]);
+    }
+    mesh.indices = std::move(sorted);
+    set_view_from_owned();
+
+    auto end_time = std::chrono::high_resolution_clock::now();
+    build_stats = builder.stats;
+    build_stats.build_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+}
+
+TriangleMesh::TriangleMesh(const MeshView &view, shared_ptr<const void> storage, shared_ptr<Material> m)
+    : mat_ptr(m), view(view), storage(std::move(storage)) {
+    build_stats.primitive_count = view.triangle_count;
+    build_stats.node_count = view.node_count;
+    set_box_from_root();
+}
+
+void TriangleMesh::set_view_from_owned() {
+    view = MeshView();
+    view.x = mesh.x.data();
+    view.y = mesh.y.data();
+    view.z = mesh.z.data();
+    if (mesh.has_normals()) {
+        view.nx = mesh.nx.data();
+        view.ny = mesh.ny.data();
+        view.nz = mesh.nz.data();
+    }
+    if (mesh.has_uvs()) {
+        view.u = mesh.u.data();
+        view.v = mesh.v.data();
+    }
+    view.indices = mesh.indices.data();
+    view.nodes = nodes.data();
+    view.vertex_count = mesh.vertex_count();
+    view.triangle_count = mesh.triangle_count();
+    view.node_count = nodes.size();
+    set_box_from_root();
+}
+
+void TriangleMesh::set_box_from_root() {
+    if (view.node_count > 0) {
+        const auto &root = view.nodes[0];
+        box = Aabb(
+            Point3(root.bounds_min[0], root.bounds_min[1], root.bounds_min[2]),
+            Point3(root.bounds_max[0], root.bounds_max[1], root.bounds_max[2])
+        );
+    }
+}
+
+size_t TriangleMesh::memory_bytes() const {
+    size_t attributes = 3 + (view.has_normals() ? 3 : 0) + (view.has_uvs() ? 2 : 0);
+    return attributes * view.vertex_count * sizeof(float)
+         + view.triangle_count * 3 * sizeof(uint32_t)
+         + view.node_count * sizeof(LinearBVHNode);
+}
+
+TriangleMesh::WatertightRay TriangleMesh::setup_ray(const Ray &r) {
+    WatertightRay wr;
+    auto d = r.direction();
+
+    wr.kz = 0;
+    if (fabs(d.y()) > fabs(d[wr.kz])) wr.kz = 1;
+    if (fabs(d.z()) > fabs(d[wr.kz])) wr.kz = 2;
+    wr.kx = (wr.kz + 1) % 3;
+    wr.ky = (wr.kx + 1) % 3;
+
+    // Keep the winding of the projected triangle independent of the ray.
+    if (d[wr.kz] < 0) {
+        std::swap(wr.kx, wr.ky);
+    }
+
+    wr.sx = d[wr.kx] / d[wr.kz];
+    wr.sy = d[wr.ky] / d[wr.kz];
+    wr.sz = 1.0 / d[wr.kz];
+    wr.origin = r.origin();
+    return wr;
+}
+
+bool TriangleMesh::hit_triangle(
+    const WatertightRay &wr, uint32_t tri, double t_min, double t_max,
+    double &t, double &b0, double &b1, double &b2
+) const {
+    RT_STAT_INC(triangle_tests);
+    auto a = view.position(view.indices[3 * tri]) - wr.origin;
+    auto b = view.position(view.indices[3 * tri + 1]) - wr.origin;
+    auto c = view.position(view.indices[3 * tri + 2]) - wr.origin;
+
+    double ax = a[wr.kx] - wr.sx * a[wr.kz];
+    double ay = a[wr.ky] - wr.sy * a[wr.kz];
+    double bx = b[wr.kx] - wr.sx * b[wr.kz];
+    double by = b[wr.ky] - wr.sy * b[wr.kz];
+    double cx = c[wr.kx] - wr.sx * c[wr.kz];
+    double cy = c[wr.ky] - wr.sy * c[wr.kz];
+
+    // Scaled barycentrics as 2D edge functions; a ray through an edge gives
+    // exactly zero for it, which both neighbours accept.
+    double e0 = cx * by - cy * bx;
+    double e1 = ax * cy - ay * cx;
+    double e2 = bx * ay - by * ax;
+
+    if ((e0 < 0 || e1 < 0 || e2 < 0) && (e0 > 0 || e1 > 0 || e2 > 0)) {
+        return false;
+    }
+
+    double det = e0 + e1 + e2;
+    if (det == 0) {
+        return false;
+    }
+
+    double scaled_t = e0 * wr.sz * a[wr.kz] + e1 * wr.sz * b[wr.kz] + e2 * wr.sz * c[wr.kz];
+    double inv_det = 1.0 / det;
+    t = scaled_t * inv_det;
+    if (t <= t_min || t_max < t) {
+        return false;
+    }
+
+    b0 = e0 * inv_det;
+    b1 = e1 * inv_det;
+    b2 = e2 * inv_det;
+    return true;
+}
+
+bool TriangleMesh::hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const {
+    if (view.node_count == 0) {
+        return false;
+    }
+
+    auto wr = setup_ray(r);
+    Vec3 inv_dir(1.0 / r.direction().x(), 1.0 / r.direction().y(), 1.0 / r.direction().z());
+    bool dir_is_neg[3] = { inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0 };
+    auto origin = r.origin();
+
+    uint32_t hit_tri = 0;
+    bool hit_anything = false;
+    double closest_so_far = t_max;
+    double hit_b[3] = { 0, 0, 0 };
+
+    uint32_t stack[128];
+    int stack_size = 0;
+    uint32_t current = 0;
+
+    while (true) {
+        const auto &node = view.nodes[current];
+        RT_STAT_INC(bvh_nodes_visited);
+        RT_STAT_INC(aabb_tests);
+
+        auto t0 = t_min;
+        auto t1 = closest_so_far;
+        for (int a = 0; a < 3 && t0 <= t1; a++) {
+            auto near = ((dir_is_neg[a] ? node.bounds_max[a] : node.bounds_min[a]) - origin[a]) * inv_dir[a];
+            auto far = ((dir_is_neg[a] ? node.bounds_min[a] : node.bounds_max[a]) - origin[a]) * inv_dir[a];
+            t0 = near > t0 ? near : t0;
+            t1 = far < t1 ? far : t1;
+        }
+
+        if (t0 <= t1) {
+            if (node.is_leaf()) {
+                for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                    double t, b0, b1, b2;
+                    if (hit_triangle(wr, i, t_min, closest_so_far, t, b0, b1, b2)) {
+                        hit_anything = true;
+                        closest_so_far = t;
+                        hit_tri = i;
+                        hit_b[0] = b0;
+                        hit_b[1] = b1;
+                        hit_b[2] = b2;
+                    }
+                }
+            } else {
+                if (dir_is_neg[node.axis]) {
+                    stack[stack_size++] = current + 1;
+                    current = node.offset;
+                } else {
+                    stack[stack_size++] = node.offset;
+                    current = current + 1;
+                }
+                continue;
+            }
+        }
+
+        if (stack_size == 0) {
+            break;
+        }
+        current = stack[--stack_size];
+    }
+
+    if (!hit_anything) {
+        return false;
+    }
+
+    // Fill the record once, for the closest triangle only.
+    uint32_t i0 = view.indices[3 * hit_tri];
+    uint32_t i1 = view.indices[3 * hit_tri + 1];
+    uint32_t i2 = view.indices[3 * hit_tri + 2];
+    auto p0 = view.position(i0);
+
+    // From the barycentrics rather than r.at(t): the point then carries the
+    // rounding error of the vertices, not of the whole ray, which is what
+    // offset_ray_origin() is scaled for.
+    rec.t = closest_so_far;
+    rec.p = hit_b[0] * p0 + hit_b[1] * view.position(i1) + hit_b[2] * view.position(i2);
+    rec.mat_ptr = mat_ptr.get();
+    rec.set_face_normal(r, normal(cross(view.position(i1) - p0, view.position(i2) - p0)));
+
+    if (view.has_normals()) {
+        Vec3 shading(
+            hit_b[0] * view.nx[i0] + hit_b[1] * view.nx[i1] + hit_b[2] * view.nx[i2],
+            hit_b[0] * view.ny[i0] + hit_b[1] * view.ny[i1] + hit_b[2] * view.ny[i2],
+            hit_b[0] * view.nz[i0] + hit_b[1] * view.nz[i1] + hit_b[2] * view.nz[i2]
+        );
+        if (shading.length_squared() > 0) {
+            shading = normal(shading);
+            rec.normal = dot(shading, rec.normal) < 0 ? -shading : shading;
+        }
+    }
+
+    if (view.has_uvs()) {
+        rec.u = hit_b[0] * view.u[i0] + hit_b[1] * view.u[i1] + hit_b[2] * view.u[i2];
+        rec.v = hit_b[0] * view.v[i0] + hit_b[1] * view.v[i1] + hit_b[2] * view.v[i2];
+    } else {
+        rec.u = hit_b[1];
+        rec.v = hit_b[2];
+    }
+
+    return true;
+}
+
+#endif
@@ -6,108 +6,193 @@
 
 using std::sqrt;
 
-class Vec3 {
+#if defined(RT_VEC3_SIMD) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#include <xmmintrin.h>
+#define RT_VEC3_SSE
+#elif defined(RT_VEC3_SIMD) && (defined(__ARM_NEON) || defined(_M_ARM64))
+#include <arm_neon.h>
+#define RT_VEC3_NEON
+#endif
+
+/// @brief Scalar type of Vec3, Point3 and Color. Double unless the program
+///        is built with RT_USE_FLOAT.
+#ifdef RT_USE_FLOAT
+using Real = float;
+#else
+using Real = double;
+#endif
+
+/// @brief How a Vec3T<T> is stored: three scalars, or with RT_VEC3_SIMD on
+///        SSE or NEON, four 16-byte aligned floats worked on as one
+///        register. The fourth lane is padding and stays zero.
+template <typename T>
+struct Vec3Layout {
+    static constexpr int size = 3;
+    static constexpr size_t align = alignof(T);
+};
+
+#if defined(RT_VEC3_SSE) || defined(RT_VEC3_NEON)
+template <>
+struct Vec3Layout<float> {
+    static constexpr int size = 4;
+    static constexpr size_t align = 16;
+};
+#endif
+
+template <typename T>
+class alignas(Vec3Layout<T>::align) Vec3T {
     public:
-        double e[3];
-    
+        T e[Vec3Layout<T>::size];
+
     public:
-        Vec3(): e{0, 0, 0} {}
-        Vec3(double e0, double e1, double e2): e{e0, e1, e2} {}
-
-        double x() const { return e[0]; }
-        double y() const { return e[1]; }
-        double z() const { return e[2]; }
-
-        Vec3 operator-() const { return Vec3(-e[0], -e[1], -e[2]); }
-        double operator[](int i) const { return e[i]; }
-        double& operator[](int i) { return e[i]; }
-
-        Vec3& operator+=(const Vec3 &v) {
-            e[0] += v.e[0];
-            e[1] += v.e[1];
-            e[2] += v.e[2];
-            return *this;
+        Vec3T(): e{} {}
+        Vec3T(T e0, T e1, T e2): e{e0, e1, e2} {}
+        template <typename U>
+        explicit Vec3T(const Vec3T<U> &v): e{static_cast<T>(v.e[0]), static_cast<T>(v.e[1]), static_cast<T>(v.e[2])} {}
+
+        T x() const { return e[0]; }
+        T y() const { return e[1]; }
+        T z() const { return e[2]; }
+
+        Vec3T operator-() const { return Vec3T(-e[0], -e[1], -e[2]); }
+        T operator[](int i) const { return e[i]; }
+        T& operator[](int i) { return e[i]; }
+
+        Vec3T& operator+=(const Vec3T &v) {
+            return *this = add(*this, v);
         }
 
-        Vec3& operator*=(const double t) {
-            e[0] *= t;
-            e[1] *= t;
-            e[2] *= t;
-            return *this;
+        Vec3T& operator*=(const T t) {
+            return *this = scale(*this, t);
         }
 
-        Vec3& operator/=(const double t) {
+        Vec3T& operator/=(const T t) {
             return *this *= 1/t;
         }
 
-        double length() const {
+        T length() const {
             return sqrt(length_squared());
         }
 
-        double length_squared() const {
+        T length_squared() const {
             return e[0]*e[0] + e[1]*e[1] + e[2]*e[2];
         }
 
-        inline static Vec3 random() {
-            return Vec3(random_double2(), random_double2(), random_double2());
+        inline static Vec3T random() {
+            return Vec3T(random_double2(), random_double2(), random_double2());
         }
 
-        inline static Vec3 random(double min, double max) {
-            return Vec3(random_double2(min, max), random_double2(min, max), random_double2(min, max));
+        inline static Vec3T random(double min, double max) {
+            return Vec3T(random_double2(min, max), random_double2(min, max), random_double2(min, max));
         }
 
         bool near_zero() const {
             const auto s = 1e-8;
             return (fabs(e[0]) < s && (fabs(e[1]) < s) && (fabs(e[2]) < s));
         }
-};
 
-using Point3 = Vec3;
-using Color = Vec3;
+        // Vec3 util funcs. Friends rather than templates, so a double
+        // scalar still converts when Real is float.
 
-// Vec3 util funcs
+        friend std::ostream& operator<<(std::ostream &out, const Vec3T &v) {
+            return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
+        }
 
-inline std::ostream& operator<<(std::ostream &out, const Vec3 &v) {
-    return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
-}
+        friend Vec3T operator+(const Vec3T &u, const Vec3T &v) { return add(u, v); }
+        friend Vec3T operator-(const Vec3T &u, const Vec3T &v) { return sub(u, v); }
+        friend Vec3T operator*(const Vec3T &u, const Vec3T &v) { return mul(u, v); }
+        friend Vec3T operator*(T t, const Vec3T &v) { return scale(v, t); }
+        friend Vec3T operator*(const Vec3T &v, T t) { return scale(v, t); }
+        friend Vec3T operator/(const Vec3T &v, T t) { return scale(v, 1/t); }
+
+        friend T dot(const Vec3T &u, const Vec3T &v) {
+            return u.e[0] * v.e[0]
+                + u.e[1] * v.e[1]
+                + u.e[2] * v.e[2];
+        }
 
-inline Vec3 operator+(const Vec3 &u, const Vec3 &v) {
-    return Vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
-}
+        friend Vec3T cross(const Vec3T &u, const Vec3T &v) {
+            return Vec3T(
+                u.e[1] * v.e[2] - u.e[2] * v.e[1],
+                u.e[2] * v.e[0] - u.e[0] * v.e[2],
+                u.e[0] * v.e[1] - u.e[1] * v.e[0]
+            );
+        }
+
+    private:
+        // Lane-wise arithmetic, specialized below for the SIMD-backed float
+        // vector. Dot and cross stay scalar: a horizontal add costs more
+        // than it saves on three lanes.
+        static Vec3T add(const Vec3T &u, const Vec3T &v) {
+            return Vec3T(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
+        }
+
+        static Vec3T sub(const Vec3T &u, const Vec3T &v) {
+            return Vec3T(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
+        }
+
+        static Vec3T mul(const Vec3T &u, const Vec3T &v) {
+            return Vec3T(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
+        }
 
-inline Vec3 operator-(const Vec3 &u, const Vec3 &v) {
-    return Vec3(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
+        static Vec3T scale(const Vec3T &v, T t) {
+            return Vec3T(t * v.e[0], t * v.e[1], t * v.e[2]);
+        }
+};
+
+#if defined(RT_VEC3_SSE)
+template <> inline Vec3T<float> Vec3T<float>::add(const Vec3T<float> &u, const Vec3T<float> &v) {
+    Vec3T<float> r;
+    _mm_store_ps(r.e, _mm_add_ps(_mm_load_ps(u.e), _mm_load_ps(v.e)));
+    return r;
 }
 
-inline Vec3 operator*(const Vec3 &u, const Vec3 &v) {
-    return Vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
+template <> inline Vec3T<float> Vec3T<float>::sub(const Vec3T<float> &u, const Vec3T<float> &v) {
+    Vec3T<float> r;
+    _mm_store_ps(r.e, _mm_sub_ps(_mm_load_ps(u.e), _mm_load_ps(v.e)));
+    return r;
 }
 
-inline Vec3 operator*(double t, const Vec3 &v) {
-    return Vec3(t * v.e[0], t * v.e[1], t * v.e[2]);
+template <> inline Vec3T<float> Vec3T<float>::mul(const Vec3T<float> &u, const Vec3T<float> &v) {
+    Vec3T<float> r;
+    _mm_store_ps(r.e, _mm_mul_ps(_mm_load_ps(u.e), _mm_load_ps(v.e)));
+    return r;
 }
 
-inline Vec3 operator*(const Vec3 &v, double t) {
-    return t * v;
+template <> inline Vec3T<float> Vec3T<float>::scale(const Vec3T<float> &v, float t) {
+    Vec3T<float> r;
+    _mm_store_ps(r.e, _mm_mul_ps(_mm_load_ps(v.e), _mm_set1_ps(t)));
+    return r;
+}
+#elif defined(RT_VEC3_NEON)
+template <> inline Vec3T<float> Vec3T<float>::add(const Vec3T<float> &u, const Vec3T<float> &v) {
+    Vec3T<float> r;
+    vst1q_f32(r.e, vaddq_f32(vld1q_f32(u.e), vld1q_f32(v.e)));
+    return r;
 }
 
-inline Vec3 operator/(Vec3 v, double t) {
-    return (1/t) * v;
+template <> inline Vec3T<float> Vec3T<float>::sub(const Vec3T<float> &u, const Vec3T<float> &v) {
+    Vec3T<float> r;
+    vst1q_f32(r.e, vsubq_f32(vld1q_f32(u.e), vld1q_f32(v.e)));
+    return r;
 }
 
-inline double dot(const Vec3 &u, const Vec3 &v) {
-    return u.e[0] * v.e[0]
-        + u.e[1] * v.e[1]
-        + u.e[2] * v.e[2];
+template <> inline Vec3T<float> Vec3T<float>::mul(const Vec3T<float> &u, const Vec3T<float> &v) {
+    Vec3T<float> r;
+    vst1q_f32(r.e, vmulq_f32(vld1q_f32(u.e), vld1q_f32(v.e)));
+    return r;
 }
 
-inline Vec3 cross(const Vec3 &u, const Vec3 &v) {
-    return Vec3(
-        u.e[1] * v.e[2] - u.e[2] * v.e[1],
-        u.e[2] * v.e[0] - u.e[0] * v.e[2],
-        u.e[0] * v.e[1] - u.e[1] * v.e[0]
-    );
+template <> inline Vec3T<float> Vec3T<float>::scale(const Vec3T<float> &v, float t) {
+    Vec3T<float> r;
+    vst1q_f32(r.e, vmulq_f32(vld1q_f32(v.e), vdupq_n_f32(t)));
+    return r;
 }
+#endif
+
+using Vec3 = Vec3T<Real>;
+using Point3 = Vec3;
+using Color = Vec3;
 
 inline Vec3 normal(Vec3 v) {
     return v / v.length();
@@ -0,0 +1,423 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "lights.h"
+#include "material.h"
+#include "pdf.h"
+#include "scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+/// @brief Where a path stands within the current bounce.
+enum class PathStatus : uint8_t {
+    Dead,       ///< Finished; removed by the next compaction
+    Hit,        ///< Found a surface that still needs shading
+    Missed,     ///< Left the scene and picks up the background
+    Specular,   ///< Already bounced off a specular surface this round
+    Scattered   ///< Needs a direction sampled against the lights
+};
+
+/// @brief Path states of one wavefront batch, stored structure-of-arrays.
+struct PathStates {
+    std::vector<double> org_x, org_y, org_z;
+    std::vector<double> dir_x, dir_y, dir_z;
+    std::vector<double> time;
+    std::vector<double> thr_r, thr_g, thr_b;
+    std::vector<double> emission_weight;    ///< MIS weight of light the current ray hits
+    std::vector<uint32_t> pixel;
+    std::vector<int> depth;
+    std::vector<Pcg32> rng;
+
+    std::vector<HitRecord> hits;
+    std::vector<ScatterRecord> scatters;
+    std::vector<PathStatus> status;
+
+    // Shadow rays are made and traced within one bounce, so compaction
+    // never needs to move them.
+    std::vector<Ray> shadow_rays;
+    std::vector<Color> shadow_factors;      ///< Path throughput times the shadow ray's factor
+    std::vector<uint8_t> has_shadow_ray;
+
+    size_t size() const { return pixel.size(); }
+
+    void resize(size_t n) {
+        for (auto *v : { &org_x, &org_y, &org_z, &dir_x, &dir_y, &dir_z, &time, &thr_r, &thr_g, &thr_b, &emission_weight }) {
+            v->resize(n);
+        }
+        pixel.resize(n);
+        depth.resize(n);
+        rng.resize(n);
+        hits.resize(n);
+        scatters.resize(n);
+        status.resize(n);
+        shadow_rays.resize(n);
+        shadow_factors.resize(n);
+        has_shadow_ray.resize(n);
+    }
+
+    Ray ray(size_t i) const {
+        return Ray(Point3(org_x[i], org_y[i], org_z[i]), Vec3(dir_x[i], dir_y[i], dir_z[i]), time[i]);
+    }
+
+    void set_ray(size_t i, const Ray &r) {
+        org_x[i] = r.origin().x();
+        org_y[i] = r.origin().y();
+        org_z[i] = r.origin().z();
+        dir_x[i] = r.direction().x();
+        dir_y[i] = r.direction().y();
+        dir_z[i] = r.direction().z();
+        time[i] = r.time();
+    }
+
+    Color throughput(size_t i) const { return Color(thr_r[i], thr_g[i], thr_b[i]); }
+
+    void set_throughput(size_t i, const Color &c) {
+        thr_r[i] = c.x();
+        thr_g[i] = c.y();
+        thr_b[i] = c.z();
+    }
+
+    /// @brief Moves entry `from` into slot `to`, used when compacting.
+    void move(size_t from, size_t to) {
+        for (auto *v : { &org_x, &org_y, &org_z, &dir_x, &dir_y, &dir_z, &time, &thr_r, &thr_g, &thr_b, &emission_weight }) {
+            (*v)[to] = (*v)[from];
+        }
+        pixel[to] = pixel[from];
+        depth[to] = depth[from];
+        rng[to] = rng[from];
+    }
+};
+
+/// @brief Path tracer that advances a whole batch of paths one bounce at a
+///        time instead of recursing per path. Each bounce runs as separate
+///        passes over the batch: intersect, shade (grouped by material),
+///        sample the scattered direction and a shadow ray, trace the
+///        shadow rays, and compact the paths that died. Computes the same estimate as the
+///        recursive ray_color(), with every path drawing from its own
+///        generator in the same order, so images match up to rounding.
+///        Not thread safe; use one instance per worker thread.
+class WavefrontIntegrator {
+    public:
+        /// @brief Work done so far, summed over every tile rendered. Rays are
+        ///        counted as they are traced; camera rays are primary, all
+        ///        bounces secondary, and rays towards lights shadow rays.
+        ///        Stage times are wall-clock per stage.
+        struct Stats {
+            uint64_t primary_rays = 0;
+            uint64_t secondary_rays = 0;
+            uint64_t shadow_rays = 0;
+            double generate_ms = 0;
+            double primary_intersect_ms = 0;
+            double secondary_intersect_ms = 0;
+            double shade_ms = 0;
+            double sample_ms = 0;
+            double shadow_ms = 0;
+            double compact_ms = 0;
+        };
+
+        Stats stats;
+
+    private:
+        const Hittable &world;
+        const LightSampler &lights;
+        Color background;
+        int max_depth;
+        size_t batch_size;
+
+        PathStates paths;
+        std::vector<const Material *> materials;
+        std::vector<uint32_t> bucket_sizes;
+        std::vector<uint32_t> bucket;
+        std::vector<uint32_t> shade_order;
+
+    public:
+        WavefrontIntegrator(
+            __F_IN__ const Hittable &world,
+            __F_IN__ const LightSampler &lights,
+            __F_IN__ const Color &background,
+            __F_IN__ int max_depth,
+            __F_IN__ size_t batch_size = 1 << 14
+        ) : world(world), lights(lights), background(background), max_depth(max_depth), batch_size(batch_size) {
+            // Allocate the full batch once; tiles only ever shrink it.
+            paths.resize(batch_size);
+            bucket.resize(batch_size);
+            shade_order.resize(batch_size);
+        }
+
+        /// @brief Renders samples [first_sample, first_sample + sample_count)
+        ///        of every pixel in a tile, adding the summed radiance of each
+        ///        pixel into framebuffer[j * width + i].
+        void render_tile(
+            __F_IN__ const Tile &tile,
+            __F_IN__ const Camera &cam,
+            __F_IN__ int image_width,
+            __F_IN__ int image_height,
+            __F_IN__ int first_sample,
+            __F_IN__ int sample_count,
+            __F_INOUT__ Color *framebuffer
+        );
+
+    private:
+        size_t generate(const Tile &tile, const Camera &cam, int image_width, int image_height,
+                        int first_sample, int sample_count, size_t first_path);
+        size_t intersect(size_t count);
+        void shade(size_t count, Color *framebuffer);
+        void sample_lights(size_t count);
+        size_t trace_shadows(size_t count, Color *framebuffer);
+        size_t compact(size_t count);
+};
+
+void WavefrontIntegrator::render_tile(
+    const Tile &tile,
+    const Camera &cam,
+    int image_width,
+    int image_height,
+    int first_sample,
+    int sample_count,
+    Color *framebuffer
+) {
+    auto tile_pixels = static_cast<size_t>(tile.x1 - tile.x0) * (tile.y1 - tile.y0);
+    auto total = tile_pixels * sample_count;
+
+    paths.resize(std::min(batch_size, total));
+
+    using clock = std::chrono::high_resolution_clock;
+    auto ms_since = [](clock::time_point &t) {
+        auto now = clock::now();
+        double ms = std::chrono::duration<double, std::milli>(now - t).count();
+        t = now;
+        return ms;
+    };
+
+    for (size_t first = 0; first < total; first += paths.size()) {
+        auto t = clock::now();
+        auto count = generate(tile, cam, image_width, image_height, first_sample, sample_count, first);
+        stats.generate_ms += ms_since(t);
+
+        bool primary = true;
+        while (count > 0) {
+            auto traced = intersect(count);
+            if (primary) {
+                stats.primary_rays += traced;
+                stats.primary_intersect_ms += ms_since(t);
+            } else {
+                stats.secondary_rays += traced;
+                stats.secondary_intersect_ms += ms_since(t);
+            }
+            primary = false;
+
+            shade(count, framebuffer);
+            stats.shade_ms += ms_since(t);
+            sample_lights(count);
+            stats.sample_ms += ms_since(t);
+            stats.shadow_rays += trace_shadows(count, framebuffer);
+            stats.shadow_ms += ms_since(t);
+            count = compact(count);
+            stats.compact_ms += ms_since(t);
+        }
+    }
+}
+
+size_t WavefrontIntegrator::generate(
+    const Tile &tile, const Camera &cam, int image_width, int image_height,
+    int first_sample, int sample_count, size_t first_path
+) {
+    auto tile_width = static_cast<size_t>(tile.x1 - tile.x0);
+    auto tile_pixels = tile_width * (tile.y1 - tile.y0);
+    auto count = std::min(paths.size(), tile_pixels * sample_count - first_path);
+
+    for (size_t n = 0; n < count; n++) {
+        auto id = first_path + n;
+        auto local = id / sample_count;
+        auto s = first_sample + static_cast<int>(id % sample_count);
+        auto i = tile.x0 + static_cast<int>(local % tile_width);
+        auto j = tile.y0 + static_cast<int>(local / tile_width);
+        auto pixel_index = static_cast<uint64_t>(j) * image_width + i;
+
+        seed_thread_rng(pixel_index, s);
+        auto u = (i + random_double2()) / (image_width - 1);
+        auto v = (j + random_double2()) / (image_height - 1);
+
+        paths.set_ray(n, cam.get_ray(u, v));
+        paths.set_throughput(n, Color(1, 1, 1));
+        paths.emission_weight[n] = 1;
+        paths.pixel[n] = static_cast<uint32_t>(pixel_index);
+        paths.depth[n] = max_depth;
+        paths.rng[n] = thread_rng();
+    }
+
+    RT_STAT_ADD(camera_paths, count);
+    return count;
+}
+
+size_t WavefrontIntegrator::intersect(size_t count) {
+    size_t traced = 0;
+    for (size_t n = 0; n < count; n++) {
+        if (paths.depth[n] <= 0) {
+            RT_STAT_INC(paths_depth_limited);
+            paths.status[n] = PathStatus::Dead;
+            continue;
+        }
+        traced++;
+
+        // Participating media draw random numbers inside hit().
+        thread_rng() = paths.rng[n];
+        bool hit;
+        {
+            RT_STAT_TIMER(intersect_ns);
+            hit = world.hit(paths.ray(n), 0, INF, paths.hits[n]);
+        }
+        paths.rng[n] = thread_rng();
+
+        paths.status[n] = hit ? PathStatus::Hit : PathStatus::Missed;
+    }
+    RT_STAT_ADD(rays_traced, traced);
+    return traced;
+}
+
+void WavefrontIntegrator::shade(size_t count, Color *framebuffer) {
+    // Escaped paths pick up the background and end here.
+    for (size_t n = 0; n < count; n++) {
+        if (paths.status[n] == PathStatus::Missed) {
+            RT_STAT_INC(paths_escaped);
+            framebuffer[paths.pixel[n]] += paths.throughput(n) * background;
+            paths.status[n] = PathStatus::Dead;
+        }
+    }
+
+    // Group surviving paths by material with a counting sort, so each run
+    // below calls the same scatter() over and over on the same data. Scenes
+    // have few materials, so a linear lookup finds each path's bucket.
+    materials.clear();
+    bucket_sizes.clear();
+    size_t live = 0;
+    for (size_t n = 0; n < count; n++) {
+        if (paths.status[n] != PathStatus::Hit) {
+            continue;
+        }
+
+        const Material *mat = paths.hits[n].mat_ptr;
+        uint32_t b = 0;
+        while (b < materials.size() && materials[b] != mat) {
+            b++;
+        }
+        if (b == materials.size()) {
+            materials.push_back(mat);
+            bucket_sizes.push_back(0);
+        }
+        bucket[n] = b;
+        bucket_sizes[b]++;
+        live++;
+    }
+
+    uint32_t offset = 0;
+    for (auto &size : bucket_sizes) {
+        auto start = offset;
+        offset += size;
+        size = start;
+    }
+    for (size_t n = 0; n < count; n++) {
+        if (paths.status[n] == PathStatus::Hit) {
+            shade_order[bucket_sizes[bucket[n]]++] = static_cast<uint32_t>(n);
+        }
+    }
+
+    for (size_t k = 0; k < live; k++) {
+        auto n = shade_order[k];
+        const auto &rec = paths.hits[n];
+        auto r = paths.ray(n);
+        auto &srec = paths.scatters[n];
+
+        thread_rng() = paths.rng[n];
+
+        Color emitted = paths.emission_weight[n] * rec.mat_ptr->emitted(r, rec, rec.u, rec.v, rec.p);
+        framebuffer[paths.pixel[n]] += paths.throughput(n) * emitted;
+
+        if (!rec.mat_ptr->scatter(r, rec, srec)) {
+            RT_STAT_INC(paths_absorbed);
+            paths.status[n] = PathStatus::Dead;
+        } else if (srec.is_specular) {
+            paths.set_throughput(n, paths.throughput(n) * srec.attenuation);
+            paths.set_ray(n, srec.specular_ray);
+            paths.emission_weight[n] = 1;
+            paths.depth[n]--;
+            paths.status[n] = PathStatus::Specular;
+        } else {
+            paths.status[n] = PathStatus::Scattered;
+        }
+
+        paths.rng[n] = thread_rng();
+    }
+}
+
+void WavefrontIntegrator::sample_lights(size_t count) {
+    for (size_t n = 0; n < count; n++) {
+        paths.has_shadow_ray[n] = 0;
+        if (paths.status[n] != PathStatus::Scattered) {
+            continue;
+        }
+
+        const auto &rec = paths.hits[n];
+        const auto &srec = paths.scatters[n];
+        auto r = paths.ray(n);
+
+        thread_rng() = paths.rng[n];
+
+        auto bounce = sample_bounce(r, rec, srec, lights);
+
+        // As in shade_hit(), only where the continued path could still
+        // have hit the light itself.
+        if (bounce.has_shadow_ray && paths.depth[n] > 1) {
+            paths.has_shadow_ray[n] = 1;
+            paths.shadow_rays[n] = bounce.shadow_ray;
+            paths.shadow_factors[n] = paths.throughput(n) * bounce.shadow_factor;
+        }
+
+        paths.set_throughput(n, paths.throughput(n) * bounce.scattered_factor);
+        paths.set_ray(n, bounce.scattered);
+        paths.emission_weight[n] = bounce.emission_weight;
+        paths.depth[n]--;
+
+        paths.rng[n] = thread_rng();
+    }
+}
+
+size_t WavefrontIntegrator::trace_shadows(size_t count, Color *framebuffer) {
+    size_t traced = 0;
+    for (size_t n = 0; n < count; n++) {
+        if (!paths.has_shadow_ray[n]) {
+            continue;
+        }
+        traced++;
+
+        // Media draw inside hit(), ahead of the path's next bounce.
+        thread_rng() = paths.rng[n];
+        framebuffer[paths.pixel[n]] += paths.shadow_factors[n] * emission_along(world, paths.shadow_rays[n]);
+        paths.rng[n] = thread_rng();
+    }
+    return traced;
+}
+
+size_t WavefrontIntegrator::compact(size_t count) {
+    size_t live = 0;
+    for (size_t n = 0; n < count; n++) {
+        if (paths.status[n] == PathStatus::Dead) {
+            continue;
+        }
+        if (live != n) {
+            paths.move(n, live);
+        }
+        live++;
+    }
+    return live;
+}
+
+#endif
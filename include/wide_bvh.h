@@ -0,0 +1,635 @@
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+#include "rtweekend.h"
+
+#include "aabb.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "linear_bvh.h"
+#include "primitive_store.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define RT_WIDE_BVH_SSE 1
+    #include <emmintrin.h>
+#else
+    #define RT_WIDE_BVH_SSE 0
+#endif
+
+/// @brief A 4-wide BVH node. Child bounds are stored structure-of-arrays,
+///        bounds[k][c] being plane k (min x, y, z, then max x, y, z) of
+///        child c, so one SSE slab test covers all four children.
+///        A child with count > 0 is a leaf over primitives
+///        [offset, offset + count); with count == 0 it is the node at
+///        index offset. Unused slots have empty (inverted) bounds.
+struct alignas(64) WideBVHNode {
+    float bounds[6][4];
+    uint32_t offset[4];
+    uint16_t count[4];
+};
+
+static_assert(sizeof(WideBVHNode) == 128, "WideBVHNode must stay two cache lines");
+
+/// @brief Ray data used by the wide traversal, computed once per ray.
+struct RayTraversalData {
+    float origin[3];
+    float inv_dir[3];
+    int near_plane[3];
+    int far_plane[3];
+
+    RayTraversalData(const Ray &r) {
+        for (int a = 0; a < 3; a++) {
+            origin[a] = static_cast<float>(r.origin()[a]);
+            inv_dir[a] = static_cast<float>(1.0 / r.direction()[a]);
+            // From inv_dir, not the direction: a -0.0 component gives -inf.
+            bool neg = inv_dir[a] < 0;
+            near_plane[a] = neg ? 3 + a : a;
+            far_plane[a] = neg ? a : 3 + a;
+        }
+    }
+};
+
+/// @brief A 4-ary BVH made by collapsing the binary SAH tree of
+///        BVHBuilder, traversed with an SSE slab test against all children
+///        of a node at once. Leaves hold PrimitiveIds into a
+///        PrimitiveStore, sorted by kind so each leaf is a few runs of one
+///        type. Leaf size is the SAH's call, bounded by
+///        max_prims_in_leaf and steered by primitive_cost; at 4 and 1.0
+///        the random and final scenes trace fastest, as a node of four
+///        float slab tests costs about as much as one primitive.
+class WideBVH : public Hittable {
+    public:
+        std::vector<WideBVHNode> nodes;
+        std::vector<shared_ptr<Hittable>> primitives;
+        /// primitive_ids[i] is where primitives[i] lives in the store.
+        std::vector<PrimitiveId> primitive_ids;
+        PrimitiveStore store;
+        Aabb box;
+        BVHBuildStats build_stats;
+
+    public:
+        WideBVH() {}
+        WideBVH(
+            __F_IN__ const HittableList &list,
+            __F_IN__ double time0,
+            __F_IN__ double time1,
+            __F_IN__ int max_prims_in_leaf = 4,
+            __F_IN__ int threads = 0,
+            __F_IN__ double primitive_cost = 1.0
+        ) : WideBVH(list.objects, time0, time1, max_prims_in_leaf, threads, primitive_cost) {}
+        WideBVH(
+            __F_IN__ const std::vector<shared_ptr<Hittable>> &src_objects,
+            __F_IN__ double time0,
+            __F_IN__ double time1,
+            __F_IN__ int max_prims_in_leaf = 4,
+            __F_IN__ int threads = 0,
+            __F_IN__ double primitive_cost = 1.0
+        );
+
+        virtual bool hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const override;
+        virtual void hit_packet(
+            RayPacket8 &packet, double t_min, HitRecord recs[RayPacket8::size], uint32_t &hit_mask
+        ) const override;
+        virtual bool bounding_box(double time0, double time1, Aabb &output_box) const override {
+            output_box = box;
+            return !primitives.empty();
+        }
+
+        virtual void children(std::vector<shared_ptr<Hittable>> &out) const override {
+            out.insert(out.end(), primitives.begin(), primitives.end());
+        }
+
+        /// @brief Slab test of a ray against the four children of a node.
+        /// @param t_near Entry distance of every child that was hit
+        /// @return Bit c is set when child c is hit within [t_min, t_max]
+        static int intersect_children(
+            __F_IN__ const WideBVHNode &node,
+            __F_IN__ const RayTraversalData &ray,
+            __F_IN__ float t_min,
+            __F_IN__ float t_max,
+            __F_OUT__ float t_near[4]
+        );
+
+        /// @brief Slab test of one child box against all lanes of a packet.
+        /// @param org Ray origins per axis, one float per lane
+        /// @param inv Inverse ray directions per axis, one float per lane
+        /// @param t_hi Per-lane far limit, -inf for lanes to skip
+        /// @return Bit k is set when lane k hits the box
+        static uint32_t slab_test_lanes(
+            __F_IN__ const WideBVHNode &node,
+            __F_IN__ int child,
+            __F_IN__ const float org[3][RayPacket8::size],
+            __F_IN__ const float inv[3][RayPacket8::size],
+            __F_IN__ float t_lo,
+            __F_IN__ const float t_hi[RayPacket8::size],
+            __F_OUT__ float t0[RayPacket8::size],
+            __F_OUT__ float t1[RayPacket8::size]
+        );
+
+    private:
+        uint32_t collapse(const std::vector<LinearBVHNode> &binary, uint32_t root);
+};
+
+WideBVH::WideBVH(
+    const std::vector<shared_ptr<Hittable>> &src_objects,
+    double time0,
+    double time1,
+    int max_prims_in_leaf,
+    int threads,
+    double primitive_cost
+) {
+    auto start_time = std::chrono::high_resolution_clock::now();
+    std::vector<Aabb> boxes(src_objects.size());
+
+    for (size_t i = 0; i < src_objects.size(); i++) {
+        if (!src_objects[i]->bounding_box(time0, time1, boxes[i])) {
+            std::cerr << "No bounding box in WideBVH constructor.\n";
+        }
+    }
+
+    BVHBuilder builder(std::move(boxes), max_prims_in_leaf, threads, primitive_cost);
+
+    primitives.reserve(src_objects.size());
+    for (auto index : builder.order) {
+        primitives.push_back(src_objects[index]);
+    }
+
+    if (!builder.nodes.empty()) {
+        const auto &root = builder.nodes[0];
+        box = Aabb(
+            Point3(root.bounds_min[0], root.bounds_min[1], root.bounds_min[2]),
+            Point3(root.bounds_max[0], root.bounds_max[1], root.bounds_max[2])
+        );
+
+        if (root.is_leaf()) {
+            // Keep traversal uniform by hanging a lone leaf under a wide root.
+            nodes.emplace_back();
+            auto &node = nodes.back();
+            for (int c = 0; c < 4; c++) {
+                for (int a = 0; a < 3; a++) {
+                    node.bounds[a][c] = c == 0 ? root.bounds_min[a] : INFINITY;
+                    node.bounds[3 + a][c] = c == 0 ? root.bounds_max[a] : -INFINITY;
+                }
+                node.offset[c] = c == 0 ? root.offset : 0;
+                node.count[c] = c == 0 ? root.count : 0;
+            }
+        } else {
+            nodes.reserve(builder.nodes.size() / 2 + 1);
+            collapse(builder.nodes, 0);
+        }
+    }
+
+    for (const auto &node : nodes) {
+        for (int c = 0; c < 4; c++) {
+            if (node.count[c] > 0) {
+                auto first = primitives.begin() + node.offset[c];
+                std::stable_sort(first, first + node.count[c], [](const shared_ptr<Hittable> &a, const shared_ptr<Hittable> &b) {
+                    return a->kind() < b->kind();
+                });
+            }
+        }
+    }
+    primitive_ids.reserve(primitives.size());
+    for (const auto &object : primitives) {
+        primitive_ids.push_back(store.add(object));
+    }
+
+    auto end_time = std::chrono::high_resolution_clock::now();
+    build_stats = builder.stats;
+    build_stats.node_count = nodes.size();
+    build_stats.leaf_count = 0;
+    build_stats.max_depth = 0;
+
+    std::vector<std::pair<uint32_t, int>> pending;
+    if (!nodes.empty()) {
+        pending.push_back({ 0, 1 });
+    }
+    while (!pending.empty()) {
+        auto entry = pending.back();
+        pending.pop_back();
+        build_stats.max_depth = std::max(build_stats.max_depth, entry.second);
+
+        const auto &node = nodes[entry.first];
+        for (int c = 0; c < 4; c++) {
+            if (node.count[c] > 0) {
+                build_stats.leaf_count++;
+            } else if (node.bounds[0][c] <= node.bounds[3][c]) {
+                pending.push_back({ node.offset[c], entry.second + 1 });
+            }
+        }
+    }
+    build_stats.build_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+}
+
+uint32_t WideBVH::collapse(const std::vector<LinearBVHNode> &binary, uint32_t root) {
+    // Open the children of the binary node, then keep replacing the
+    // interior child with the largest surface area by its own two children
+    // until four slots are filled or only leaves are left.
+    uint32_t children[4] = { root + 1, binary[root].offset, 0, 0 };
+    int child_count = 2;
+
+    auto area = [&binary](uint32_t n) {
+        const auto &node = binary[n];
+        auto dx = node.bounds_max[0] - node.bounds_min[0];
+        auto dy = node.bounds_max[1] - node.bounds_min[1];
+        auto dz = node.bounds_max[2] - node.bounds_min[2];
+        return dx * dy + dy * dz + dz * dx;
+    };
+
+    while (child_count < 4) {
+        int best = -1;
+        for (int c = 0; c < child_count; c++) {
+            if (!binary[children[c]].is_leaf() && (best < 0 || area(children[c]) > area(children[best]))) {
+                best = c;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+
+        auto opened = children[best];
+        children[best] = opened + 1;
+        children[child_count++] = binary[opened].offset;
+    }
+
+    auto index = static_cast<uint32_t>(nodes.size());
+    nodes.emplace_back();
+
+    for (int c = 0; c < 4; c++) {
+        auto &node = nodes[index];
+        if (c >= child_count) {
+            for (int a = 0; a < 3; a++) {
+                node.bounds[a][c] = INFINITY;
+                node.bounds[3 + a][c] = -INFINITY;
+            }
+            node.offset[c] = 0;
+            node.count[c] = 0;
+            continue;
+        }
+
+        const auto &child = binary[children[c]];
+        for (int a = 0; a < 3; a++) {
+            node.bounds[a][c] = child.bounds_min[a];
+            node.bounds[3 + a][c] = child.bounds_max[a];
+        }
+
+        if (child.is_leaf()) {
+            node.offset[c] = child.offset;
+            node.count[c] = child.count;
+        } else {
+            node.count[c] = 0;
+            // nodes may reallocate while the subtree is collapsed
+            auto child_index = collapse(binary, children[c]);
+            nodes[index].offset[c] = child_index;
+        }
+    }
+
+    return index;
+}
+
+inline int WideBVH::intersect_children(
+    const WideBVHNode &node,
+    const RayTraversalData &ray,
+    float t_min,
+    float t_max,
+    float t_near[4]
+) {
+#if RT_WIDE_BVH_SSE
+    auto t0 = _mm_set1_ps(t_min);
+    auto t1 = _mm_set1_ps(t_max);
+
+    for (int a = 0; a < 3; a++) {
+        auto o = _mm_set1_ps(ray.origin[a]);
+        auto inv = _mm_set1_ps(ray.inv_dir[a]);
+        auto near = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[ray.near_plane[a]]), o), inv);
+        auto far = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[ray.far_plane[a]]), o), inv);
+        // A NaN slab (zero direction, origin on the plane) must not widen
+        // or narrow the interval, so it goes in the first operand.
+        t0 = _mm_max_ps(near, t0);
+        t1 = _mm_min_ps(far, t1);
+    }
+
+    _mm_storeu_ps(t_near, t0);
+    return _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+#else
+    int mask = 0;
+    for (int c = 0; c < 4; c++) {
+        auto t0 = t_min;
+        auto t1 = t_max;
+        for (int a = 0; a < 3; a++) {
+            auto near = (node.bounds[ray.near_plane[a]][c] - ray.origin[a]) * ray.inv_dir[a];
+            auto far = (node.bounds[ray.far_plane[a]][c] - ray.origin[a]) * ray.inv_dir[a];
+            t0 = near > t0 ? near : t0;
+            t1 = far < t1 ? far : t1;
+        }
+        t_near[c] = t0;
+        mask |= (t0 <= t1) << c;
+    }
+    return mask;
+#endif
+}
+
+inline uint32_t WideBVH::slab_test_lanes(
+    const WideBVHNode &node,
+    int child,
+    const float org[3][RayPacket8::size],
+    const float inv[3][RayPacket8::size],
+    float t_lo,
+    const float t_hi[RayPacket8::size],
+    float t0[RayPacket8::size],
+    float t1[RayPacket8::size]
+) {
+    uint32_t mask = 0;
+#if RT_WIDE_BVH_SSE
+    for (int h = 0; h < RayPacket8::size; h += 4) {
+        auto near_t = _mm_set1_ps(t_lo);
+        auto far_t = _mm_load_ps(t_hi + h);
+
+        for (int a = 0; a < 3; a++) {
+            auto o = _mm_load_ps(org[a] + h);
+            auto iv = _mm_load_ps(inv[a] + h);
+            auto ta = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bounds[a][child]), o), iv);
+            auto tb = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bounds[3 + a][child]), o), iv);
+            near_t = _mm_max_ps(_mm_min_ps(ta, tb), near_t);
+            far_t = _mm_min_ps(_mm_max_ps(ta, tb), far_t);
+        }
+
+        _mm_store_ps(t0 + h, near_t);
+        _mm_store_ps(t1 + h, far_t);
+        mask |= static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(near_t, far_t))) << h;
+    }
+#else
+    for (int k = 0; k < RayPacket8::size; k++) {
+        t0[k] = t_lo;
+        t1[k] = t_hi[k];
+        for (int a = 0; a < 3; a++) {
+            auto ta = (node.bounds[a][child] - org[a][k]) * inv[a][k];
+            auto tb = (node.bounds[3 + a][child] - org[a][k]) * inv[a][k];
+            auto near = ta < tb ? ta : tb;
+            auto far = ta < tb ? tb : ta;
+            t0[k] = near > t0[k] ? near : t0[k];
+            t1[k] = far < t1[k] ? far : t1[k];
+        }
+        mask |= static_cast<uint32_t>(t0[k] <= t1[k]) << k;
+    }
+#endif
+    return mask;
+}
+
+bool WideBVH::hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const {
+    if (nodes.empty()) {
+        return false;
+    }
+
+    RayTraversalData ray(r);
+
+    // Float slab distances can be off by a few ulps; widen the far end so a
+    // box is never culled by rounding alone.
+    const float far_scale = 1.0f + 4 * std::numeric_limits<float>::epsilon();
+
+    bool hit_anything = false;
+    auto closest_so_far = t_max;
+    LeafHit leaf_hit;
+
+    uint32_t stack[256];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+
+    while (stack_size > 0) {
+        const auto &node = nodes[stack[--stack_size]];
+        RT_STAT_INC(bvh_nodes_visited);
+        RT_STAT_ADD(aabb_tests, 4);
+
+        float t_near[4];
+        auto t_far = static_cast<float>(closest_so_far) * far_scale;
+        int mask = intersect_children(node, ray, static_cast<float>(t_min), t_far, t_near);
+
+        if (mask == 0) {
+            continue;
+        }
+
+        // Order the children that were hit far to near, so the nearest one
+        // ends up on top of the stack; leaves are intersected right away.
+        int order[4];
+        int n = 0;
+        for (int c = 0; c < 4; c++) {
+            if (!(mask & (1 << c))) {
+                continue;
+            }
+
+            if (node.count[c] > 0) {
+                auto end = node.offset[c] + node.count[c];
+                for (auto i = node.offset[c]; i < end;) {
+                    auto run_end = i + 1;
+                    auto kind = primitive_kind(primitive_ids[i]);
+                    while (run_end < end && primitive_kind(primitive_ids[run_end]) == kind) {
+                        run_end++;
+                    }
+
+                    if (store.hit_run(primitive_ids[i], run_end - i, r, t_min, closest_so_far, leaf_hit, rec)) {
+                        hit_anything = true;
+                    }
+                    i = run_end;
+                }
+                continue;
+            }
+
+            int k = n++;
+            while (k > 0 && t_near[order[k - 1]] < t_near[c]) {
+                order[k] = order[k - 1];
+                k--;
+            }
+            order[k] = c;
+        }
+
+        for (int k = 0; k < n; k++) {
+            stack[stack_size++] = node.offset[order[k]];
+        }
+    }
+
+    if (leaf_hit.deferred) {
+        store.set_hit_record(leaf_hit, r, closest_so_far, rec);
+    }
+    return hit_anything;
+}
+
+void WideBVH::hit_packet(RayPacket8 &packet, double t_min, HitRecord recs[RayPacket8::size], uint32_t &hit_mask) const {
+    const int n = RayPacket8::size;
+    if (nodes.empty() || packet.active == 0) {
+        return;
+    }
+
+    // Lanes are the vector dimension here: each child box is tested against
+    // all eight rays in one branch-free loop over float arrays, and every
+    // node is fetched once for the whole packet.
+    alignas(16) float org[3][n];
+    alignas(16) float inv[3][n];
+    for (int k = 0; k < n; k++) {
+        org[0][k] = static_cast<float>(packet.org_x[k]);
+        org[1][k] = static_cast<float>(packet.org_y[k]);
+        org[2][k] = static_cast<float>(packet.org_z[k]);
+        inv[0][k] = static_cast<float>(1.0 / packet.dir_x[k]);
+        inv[1][k] = static_cast<float>(1.0 / packet.dir_y[k]);
+        inv[2][k] = static_cast<float>(1.0 / packet.dir_z[k]);
+    }
+
+    const float far_scale = 1.0f + 4 * std::numeric_limits<float>::epsilon();
+    const auto t_lo = static_cast<float>(t_min);
+
+    // When every lane points into the same octant the packet can be culled
+    // as a whole: interval arithmetic over the lanes' origins and inverse
+    // directions gives one conservative slab test per child for all of them.
+    bool coherent = RT_WIDE_BVH_SSE != 0;
+    float org_min[3], org_max[3], inv_min[3], inv_max[3];
+    int near_plane[3];
+
+    for (int a = 0; a < 3; a++) {
+        org_min[a] = inv_min[a] = INFINITY;
+        org_max[a] = inv_max[a] = -INFINITY;
+        for (int k = 0; k < n; k++) {
+            if (!packet.is_active(k)) {
+                continue;
+            }
+            org_min[a] = std::min(org_min[a], org[a][k]);
+            org_max[a] = std::max(org_max[a], org[a][k]);
+            inv_min[a] = std::min(inv_min[a], inv[a][k]);
+            inv_max[a] = std::max(inv_max[a], inv[a][k]);
+        }
+        coherent = coherent && std::isfinite(inv_min[a]) && std::isfinite(inv_max[a])
+                   && (inv_min[a] > 0 || inv_max[a] < 0);
+        near_plane[a] = inv_max[a] < 0 ? 3 + a : a;
+    }
+
+    struct Entry {
+        uint32_t node;
+        uint32_t mask;
+    };
+
+    Entry stack[256];
+    int stack_size = 0;
+    stack[stack_size++] = Entry{ 0, packet.active };
+
+    while (stack_size > 0) {
+        auto entry = stack[--stack_size];
+        const auto &node = nodes[entry.node];
+        RT_STAT_INC(bvh_nodes_visited);
+
+        // Lanes outside the entry mask get an empty interval.
+        alignas(16) float t_hi[n];
+        for (int k = 0; k < n; k++) {
+            t_hi[k] = ((entry.mask >> k) & 1u) ? static_cast<float>(packet.t_max[k]) * far_scale : -INFINITY;
+        }
+
+        uint32_t child_lanes[4] = { 0, 0, 0, 0 };
+        float child_near[4] = { INFINITY, INFINITY, INFINITY, INFINITY };
+
+#if RT_WIDE_BVH_SSE
+        if (coherent) {
+            float packet_far = -INFINITY;
+            for (int k = 0; k < n; k++) {
+                packet_far = std::max(packet_far, t_hi[k]);
+            }
+
+            auto t0 = _mm_set1_ps(t_lo);
+            auto t1 = _mm_set1_ps(packet_far);
+
+            for (int a = 0; a < 3; a++) {
+                auto o_lo = _mm_set1_ps(org_min[a]);
+                auto o_hi = _mm_set1_ps(org_max[a]);
+                auto i_lo = _mm_set1_ps(inv_min[a]);
+                auto i_hi = _mm_set1_ps(inv_max[a]);
+
+                auto near_plane_v = _mm_load_ps(node.bounds[near_plane[a]]);
+                auto far_plane_v = _mm_load_ps(node.bounds[near_plane[a] < 3 ? 3 + a : a]);
+
+                auto n0 = _mm_sub_ps(near_plane_v, o_hi);
+                auto n1 = _mm_sub_ps(near_plane_v, o_lo);
+                auto near = _mm_min_ps(
+                    _mm_min_ps(_mm_mul_ps(n0, i_lo), _mm_mul_ps(n0, i_hi)),
+                    _mm_min_ps(_mm_mul_ps(n1, i_lo), _mm_mul_ps(n1, i_hi))
+                );
+
+                auto f0 = _mm_sub_ps(far_plane_v, o_hi);
+                auto f1 = _mm_sub_ps(far_plane_v, o_lo);
+                auto far = _mm_max_ps(
+                    _mm_max_ps(_mm_mul_ps(f0, i_lo), _mm_mul_ps(f0, i_hi)),
+                    _mm_max_ps(_mm_mul_ps(f1, i_lo), _mm_mul_ps(f1, i_hi))
+                );
+
+                t0 = _mm_max_ps(near, t0);
+                t1 = _mm_min_ps(far, t1);
+            }
+
+            int mask = _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+            _mm_storeu_ps(child_near, t0);
+            RT_STAT_ADD(aabb_tests, 4);
+
+            for (int c = 0; c < 4; c++) {
+                child_lanes[c] = (mask & (1 << c)) ? entry.mask : 0;
+            }
+        }
+#endif
+
+        for (int c = 0; !coherent && c < 4; c++) {
+            if (node.bounds[0][c] > node.bounds[3][c]) {
+                continue;
+            }
+
+            alignas(16) float t0[n];
+            alignas(16) float t1[n];
+            child_lanes[c] = slab_test_lanes(node, c, org, inv, t_lo, t_hi, t0, t1);
+            RT_STAT_ADD(aabb_tests, n);
+
+            for (int k = 0; k < n; k++) {
+                if (((child_lanes[c] >> k) & 1u) && t0[k] < child_near[c]) {
+                    child_near[c] = t0[k];
+                }
+            }
+        }
+
+        // Leaves are intersected right away; interior children are pushed
+        // far to near by the nearest entry distance of any lane.
+        int order[4];
+        int count = 0;
+        for (int c = 0; c < 4; c++) {
+            if (child_lanes[c] == 0) {
+                continue;
+            }
+
+            if (node.count[c] > 0) {
+                auto saved = packet.active;
+                packet.active = child_lanes[c];
+                auto end = node.offset[c] + node.count[c];
+                for (auto i = node.offset[c]; i < end;) {
+                    auto run_end = i + 1;
+                    auto kind = primitive_kind(primitive_ids[i]);
+                    while (run_end < end && primitive_kind(primitive_ids[run_end]) == kind) {
+                        run_end++;
+                    }
+
+                    store.hit_packet_run(primitive_ids[i], run_end - i, packet, t_min, recs, hit_mask);
+                    i = run_end;
+                }
+                packet.active = saved;
+                continue;
+            }
+
+            int k = count++;
+            while (k > 0 && child_near[order[k - 1]] < child_near[c]) {
+                order[k] = order[k - 1];
+                k--;
+            }
+            order[k] = c;
+        }
+
+        for (int k = 0; k < count; k++) {
+            stack[stack_size++] = Entry{ node.offset[order[k]], child_lanes[order[k]] };
+        }
+    }
+}
+
+#endif
@@ -1,559 +1,622 @@
 #include "../include/rtweekend.h"
 
 #include "../include/aarect.h"
+#include "../include/alloc_counter.h"
+#include "../include/benchmark.h"
 #include "../include/box.h"
 #include "../include/bvh.h"
 #include "../include/camera.h"
 #include "../include/color.h"
 #include "../include/constant_medium.h"
+#include "../include/heatmap.h"
 #include "../include/hittable_list.h"
+#include "../include/image.h"
+#include "../include/lights.h"
+#include "../include/linear_bvh.h"
 #include "../include/material.h"
+#include "../include/mesh_cache.h"
+#include "../include/mesh_loader.h"
 #include "../include/moving_sphere.h"
 #include "../include/pdf.h"
+#include "../include/progressive.h"
+#include "../include/scene_file.h"
+#include "../include/scenes.h"
+#include "../include/scheduler.h"
 #include "../include/sphere.h"
-
-#include "../include/external/ctpl_stl.h"
+#include "../include/wavefront.h"
+#include "../include/wide_bvh.h"
 
 #include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <chrono>
-#include <map>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 Color ray_color(
     __F_IN__ const Ray &r,
     __F_IN__ const Color &background,
     __F_IN__ const Hittable &world,
-    __F_IN__ shared_ptr<Hittable> lights,
-    __F_IN__ int depth
+    __F_IN__ const LightSampler &lights,
+    __F_IN__ int depth,
+    __F_IN__ double emission_weight
+);
+
+/// @brief Radiance leaving a surface point that `r` has already been
+///        intersected with, e.g. by a packet trace of primary rays.
+/// @param emission_weight MIS weight of light emitted at `rec`: 1 for camera
+///        and specular rays, which no shadow ray could have found
+Color shade_hit(
+    __F_IN__ const Ray &r,
+    __F_IN__ const HitRecord &rec,
+    __F_IN__ const Color &background,
+    __F_IN__ const Hittable &world,
+    __F_IN__ const LightSampler &lights,
+    __F_IN__ int depth,
+    __F_IN__ double emission_weight
 ) {
-    HitRecord rec;
-
-    if (depth <= 0) {
-        return Color(0, 0, 0);
-    }
-
-    if (!world.hit(r, 0.001, INF, rec)) {
-        return background;
-    }
-
     ScatterRecord srec;
-    Color emitted = rec.mat_ptr->emitted(r, rec, rec.u, rec.v, rec.p);
+    Color emitted = emission_weight * rec.mat_ptr->emitted(r, rec, rec.u, rec.v, rec.p);
     if (!rec.mat_ptr->scatter(r, rec, srec)) {
+        RT_STAT_INC(paths_absorbed);
         return emitted;
     }
 
-    auto light_ptr = make_shared<HittablePdf>(rec.p, lights);
-    MixturePdf p(light_ptr, srec.pdf_ptr);
-
-    Ray scattered = Ray(rec.p, p.generate(), r.time());
-    auto pdf_val = p.value(scattered.direction());
-
-    return emitted
-        + srec.attenuation * rec.mat_ptr->scattering_pdf(r, rec, scattered)
-                           * ray_color(scattered, background, world, lights, depth - 1) / pdf_val;
-}
-
-HittableList random_scene() {
-    HittableList world;
-
-    auto checker = make_shared<CheckerTexture>(Color(0.2, 0.3, 0.1), Color(0.9, 0.9, 0.9));
-    world.add(make_shared<Sphere>(Point3(0, -1000.0, 0), 1000, make_shared<Lambertian>(checker)));
-
-    for (int a = -11; a < 11; a++){
-        for (int b = -11; b < 11; b++) {
-            auto choose_mat = random_double2();
-            Point3 center(a + 0.9 * random_double2(), 0.2, b + 0.9 * random_double2());
-
-            std::cerr << "center: " << center << std::endl;
-            std::cerr << "material: " << choose_mat << std::endl;
-
-            if ((center - Point3(4, 0.2, 0)).length() > 0.9) {
-                shared_ptr<Material> sphere_material;
-                
-                if (choose_mat < 0.8) {
-                    // diffuse
-                    auto albedo = Color::random() * Color::random();
-                    sphere_material = make_shared<Lambertian>(albedo);
-                    auto center2 = center + Vec3(0, random_double2(0, 0.5), 0);
-                    world.add(make_shared<MovingSphere>(center, center2, 0.0, 1.0, 0.2, sphere_material));
-                } else if (choose_mat < 0.95) {
-                    // metal
-                    auto albedo = Color::random(0.5, 1);
-                    auto fuzz = random_double2(0, 0.5);
-                    sphere_material = make_shared<Metal>(albedo, fuzz);
-                    world.add(make_shared<Sphere>(center, 0.2, sphere_material));
-                } else {
-                    // glass
-                    sphere_material = make_shared<Dielectric>(1.5);
-                    world.add(make_shared<Sphere>(center, 0.2, sphere_material));
-                }
-            }
-        }
+    if (srec.is_specular) {
+        return srec.attenuation * ray_color(srec.specular_ray, background, world, lights, depth - 1, 1.0);
     }
 
-    auto material1 = make_shared<Dielectric>(1.5);
-    world.add(make_shared<Sphere>(Point3(0, 1, 0), 1.0, material1));
-
-    auto material2 = make_shared<Lambertian>(Color(0.4, 0.2, 0.1));
-    world.add(make_shared<Sphere>(Point3(-4, 1, 0), 1.0, material2));
-
-    auto material3 = make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.0);
-    world.add(make_shared<Sphere>(Point3(4, 1, 0), 1.0, material3));
-
-    return world;
-}
-
-HittableList two_spheres() {
-    HittableList objects;
-
-    auto checker = make_shared<CheckerTexture>(Color(0.2, 0.3, 0.1), Color(0.9, 0.9, 0.9));
+    auto bounce = sample_bounce(r, rec, srec, lights);
 
-    objects.add(make_shared<Sphere>(Point3(0, -10, 0), 10, make_shared<Lambertian>(checker)));
-    objects.add(make_shared<Sphere>(Point3(0, 10, 0), 10, make_shared<Lambertian>(checker)));
+    // Light the shadow ray finds is the next vertex's emission, so it is
+    // only counted where the continued path could still have hit it.
+    Color direct(0, 0, 0);
+    if (bounce.has_shadow_ray && depth > 1) {
+        direct = bounce.shadow_factor * emission_along(world, bounce.shadow_ray);
+    }
 
-    return objects;
+    return emitted + direct
+        + bounce.scattered_factor
+        * ray_color(bounce.scattered, background, world, lights, depth - 1, bounce.emission_weight);
 }
 
-HittableList two_perlin_spheres() {
-    HittableList objects;
+Color ray_color(
+    __F_IN__ const Ray &r,
+    __F_IN__ const Color &background,
+    __F_IN__ const Hittable &world,
+    __F_IN__ const LightSampler &lights,
+    __F_IN__ int depth,
+    __F_IN__ double emission_weight
+) {
+    HitRecord rec;
 
-    auto light = make_shared<DiffuseLight>(Color(10, 10, 10));
-    objects.add(make_shared<XZRect>(123, 423, 147, 412, 554, light));
+    if (depth <= 0) {
+        RT_STAT_INC(paths_depth_limited);
+        return Color(0, 0, 0);
+    }
 
-    auto pertext = make_shared<NoiseTexture>(0.1);
-    objects.add(make_shared<Sphere>(Point3(0, -1000, 0), 1000, make_shared<Lambertian>(pertext)));
-    objects.add(make_shared<Sphere>(Point3(220, 280, 300), 80, make_shared<Lambertian>(pertext)));
+    RT_STAT_INC(rays_traced);
+    bool hit;
+    {
+        RT_STAT_TIMER(intersect_ns);
+        hit = world.hit(r, 0, INF, rec);
+    }
+    if (!hit) {
+        RT_STAT_INC(paths_escaped);
+        return background;
+    }
 
-    return objects;
+    return shade_hit(r, rec, background, world, lights, depth, emission_weight);
 }
 
-HittableList earth() {
-    auto earth_texture = make_shared<ImageTexture>("assets/earthmap.jpg");
-    auto earth_surface = make_shared<Lambertian>(earth_texture);
-    auto globe = make_shared<Sphere>(Point3(0, 0, 0), 2, earth_surface);
-
-    return HittableList(globe);
-}
+enum class Integrator { Recursive, Wavefront };
+
+/// @brief Everything about a render that is not part of the scene.
+struct RenderSettings {
+    Integrator integrator = Integrator::Recursive;
+    int image_width = 0;
+    int image_height = 0;
+    int samples_per_pixel = 0;
+    int max_depth = 0;
+    int threads = 0;                    ///< 0 uses every core
+    bool packets = true;                ///< Recursive: trace each pixel's samples as 8-ray packets
+    ProgressiveSettings progressive;    ///< max_samples is set from samples_per_pixel
+    DebugMode debug = DebugMode::None;  ///< Render a heatmap instead of radiance
+};
+
+/// @brief Renders a scene through the tile scheduler and progressive
+///        accumulator and returns the resolved image.
+/// @param wavefront_stats If not null, the wavefront integrators' statistics,
+///        summed over all threads, are added into it
+/// @param verbose Print the tile, pass and allocation reports
+/// @return The rendered image, or a heatmap if `settings.debug` asks for one
+Image render_image(
+    __F_IN__ const Hittable &scene,
+    __F_IN__ const LightSampler &lights,
+    __F_IN__ const Camera &cam,
+    __F_IN__ const Color &background,
+    __F_IN__ const RenderSettings &settings,
+    __F_INOUT__ WavefrontIntegrator::Stats *wavefront_stats,
+    __F_IN__ bool verbose
+) {
+    const int image_width = settings.image_width;
+    const int image_height = settings.image_height;
+    const int max_depth = settings.max_depth;
+    const int threads = settings.threads > 0 ? settings.threads : static_cast<int>(std::thread::hardware_concurrency());
+
+    const int tile_size = 16;
+    const bool use_packets = settings.packets;
+
+    // The counting debug modes read each pixel's counters around its
+    // samples, so they always take the per-pixel recursive path.
+    const bool count_pixels = debug_mode_needs_stats(settings.debug);
+    std::vector<float> pixel_counts(count_pixels ? static_cast<size_t>(image_width) * image_height : 0);
+    TileScheduler scheduler(image_width, image_height, tile_size, threads);
+    scheduler.show_progress = verbose;
+
+    ProgressiveSettings progressive_settings = settings.progressive;
+    progressive_settings.max_samples = settings.samples_per_pixel;
+    ProgressiveRenderer progressive(image_width, image_height, progressive_settings);
+
+    std::vector<std::unique_ptr<WavefrontIntegrator>> wavefronts(scheduler.thread_count());
+    for (auto &w : wavefronts) {
+        w = std::make_unique<WavefrontIntegrator>(scene, lights, background, max_depth);
+    }
 
-HittableList simple_light() {
-    HittableList objects;
+    // Adds samples [first_sample, first_sample + sample_count) of every
+    // pixel in the tile into out.
+    auto render_samples = [&](const Tile &tile, int thread_id, int first_sample, int sample_count, Color *out) {
+        if (settings.integrator == Integrator::Wavefront && !count_pixels) {
+            wavefronts[thread_id]->render_tile(tile, cam, image_width, image_height, first_sample, sample_count, out);
+            return;
+        }
 
-    auto pertext = make_shared<NoiseTexture>(4);
-    objects.add(make_shared<Sphere>(Point3(0, -1000, 0), 1000, make_shared<Lambertian>(pertext)));
-    objects.add(make_shared<Sphere>(Point3(0, 2, 0), 2, make_shared<Lambertian>(pertext)));
+        for (int j = tile.y0; j < tile.y1; ++j) {
+            for (int i = tile.x0; i < tile.x1; ++i) {
+                Color pixel_color(0, 0, 0);
+                auto pixel_index = static_cast<uint64_t>(j) * image_width + i;
+                RenderStats pixel_stats_before;
+                if (count_pixels) {
+                    pixel_stats_before = thread_stats();
+                }
 
-    auto difflight = make_shared<DiffuseLight>(Color(4, 4, 4));
-    // objects.add(make_shared<XYRect>(3, 5, 1, 3, -2, difflight));
-    objects.add(make_shared<Sphere>(Point3(0, 7, 0), 2, difflight));
+                if (!use_packets) {
+                    for (int s = first_sample; s < first_sample + sample_count; s++) {
+                        seed_thread_rng(pixel_index, s);
+                        auto u = (i + random_double2()) / (image_width - 1);
+                        auto v = (j + random_double2()) / (image_height - 1);
+                        Ray r = cam.get_ray(u, v);
+                        RT_STAT_INC(camera_paths);
+                        pixel_color += ray_color(r, background, scene, lights, max_depth, 1.0);
+                    }
+                }
 
-    return objects;
-}
+                // The samples of one pixel make a coherent bundle: trace
+                // them eight at a time as a packet, then shade each lane
+                // with its own generator so the image matches the scalar path.
+                int end_sample = first_sample + sample_count;
+                for (int s0 = first_sample; use_packets && s0 < end_sample; s0 += RayPacket8::size) {
+                    int lanes = std::min(RayPacket8::size, end_sample - s0);
+                    double us[RayPacket8::size];
+                    double vs[RayPacket8::size];
+                    Pcg32 rngs[RayPacket8::size];
+
+                    for (int k = 0; k < lanes; k++) {
+                        seed_thread_rng(pixel_index, s0 + k);
+                        us[k] = (i + random_double2()) / (image_width - 1);
+                        vs[k] = (j + random_double2()) / (image_height - 1);
+                        rngs[k] = thread_rng();
+                    }
+
+                    RayPacket8 packet;
+                    cam.get_ray_packet(us, vs, lanes, packet, rngs);
+                    packet.rngs = rngs;
+
+                    HitRecord recs[RayPacket8::size];
+                    uint32_t hit_mask = 0;
+                    RT_STAT_ADD(camera_paths, lanes);
+                    RT_STAT_ADD(rays_traced, lanes);
+                    {
+                        RT_STAT_TIMER(intersect_ns);
+                        scene.hit_packet(packet, 0, recs, hit_mask);
+                    }
+
+                    for (int k = 0; k < lanes; k++) {
+                        thread_rng() = rngs[k];
+                        if ((hit_mask >> k) & 1u) {
+                            pixel_color += shade_hit(packet.ray(k), recs[k], background, scene, lights, max_depth, 1.0);
+                        } else {
+                            RT_STAT_INC(paths_escaped);
+                            pixel_color += background;
+                        }
+                    }
+                }
 
-HittableList cornell_box() {
-    HittableList objects;
+                out[static_cast<size_t>(j) * image_width + i] += pixel_color;
+                if (count_pixels) {
+                    pixel_counts[pixel_index] += static_cast<float>(heatmap_value(thread_stats() - pixel_stats_before, settings.debug));
+                }
+            }
+        }
+    };
+
+    // Heap allocations made while rendering tiles; zero unless built with
+    // RT_COUNT_ALLOCS. Rendering should not allocate once every worker has
+    // warmed up its buffers.
+    std::atomic<uint64_t> render_allocs(0);
+    std::atomic<uint64_t> render_alloc_bytes(0);
+    std::atomic<int> allocating_tiles(0);
+
+    // Hot-path counters, only with RT_ENABLE_STATS. Every worker sums the
+    // counts of its own tiles into its own slot.
+    std::vector<RenderStats> thread_render_stats(scheduler.thread_count());
+
+    progressive.render(scheduler, [&](const Tile &tile, int thread_id, int first_sample, int sample_count, Color *out) {
+        AllocStats before = thread_alloc_stats();
+#ifdef RT_ENABLE_STATS
+        RenderStats stats_before = thread_stats();
+#endif
+        render_samples(tile, thread_id, first_sample, sample_count, out);
+#ifdef RT_ENABLE_STATS
+        thread_render_stats[thread_id] += thread_stats() - stats_before;
+#endif
+        AllocStats after = thread_alloc_stats();
+
+        if (after.count != before.count) {
+            render_allocs += after.count - before.count;
+            render_alloc_bytes += after.bytes - before.bytes;
+            allocating_tiles++;
+        }
+    });
+
+    if (wavefront_stats) {
+        for (const auto &w : wavefronts) {
+            wavefront_stats->primary_rays += w->stats.primary_rays;
+            wavefront_stats->secondary_rays += w->stats.secondary_rays;
+            wavefront_stats->shadow_rays += w->stats.shadow_rays;
+            wavefront_stats->generate_ms += w->stats.generate_ms;
+            wavefront_stats->primary_intersect_ms += w->stats.primary_intersect_ms;
+            wavefront_stats->secondary_intersect_ms += w->stats.secondary_intersect_ms;
+            wavefront_stats->shade_ms += w->stats.shade_ms;
+            wavefront_stats->sample_ms += w->stats.sample_ms;
+            wavefront_stats->shadow_ms += w->stats.shadow_ms;
+            wavefront_stats->compact_ms += w->stats.compact_ms;
+        }
+    }
 
-    auto red = make_shared<Lambertian>(Color(.65, .05, .05));
-    auto green = make_shared<Lambertian>(Color(.12, .45, .15));
-    auto white = make_shared<Lambertian>(Color(.73, .73, .73));
-    auto light = make_shared<DiffuseLight>(Color(15, 15, 15));
+    if (verbose) {
+        scheduler.report(std::cerr);
+        progressive.report(std::cerr);
 
-    objects.add(make_shared<YZRect>(0, 555, 0, 555, 555, green));
-    objects.add(make_shared<YZRect>(0, 555, 0, 555, 0, red));
-    objects.add(make_shared<XZRect>(0, 555, 0, 555, 0, white));
-    objects.add(make_shared<FlipFace>(make_shared<XZRect>(213, 343, 227, 332, 554, light)));
-    objects.add(make_shared<XZRect>(0, 555, 0, 555, 555, white));
-    objects.add(make_shared<XYRect>(0, 555, 0, 555, 555, white));
+#ifdef RT_COUNT_ALLOCS
+        std::cerr << "Render allocations: " << render_allocs << " (" << render_alloc_bytes << " bytes) in "
+                  << allocating_tiles << " of " << scheduler.tile_count() << " tiles\n";
+#endif
 
-    shared_ptr<Hittable> box1 = make_shared<Box>(Point3(0, 0, 0), Point3(165, 330, 165), white);
-    box1 = make_shared<RotateY>(box1, 15);
-    box1 = make_shared<Translate>(box1, Vec3(265, 0, 295));
-    objects.add(box1);
+#ifdef RT_ENABLE_STATS
+        RenderStats total;
+        for (const auto &stats : thread_render_stats) {
+            total += stats;
+        }
+        total.report(std::cerr);
+#endif
+    }
 
-    shared_ptr<Hittable> box2 = make_shared<Box>(Point3(0, 0, 0), Point3(165, 165, 165), white);
-    box2 = make_shared<RotateY>(box2, -18);
-    box2 = make_shared<Translate>(box2, Vec3(130, 0, 65));
-    objects.add(box2);
+    if (settings.debug == DebugMode::None) {
+        return progressive.resolve();
+    }
 
-    return objects;
+    // Counts are per camera path; the samples map is the count itself.
+    std::vector<float> values(static_cast<size_t>(image_width) * image_height);
+    for (int j = 0; j < image_height; j++) {
+        for (int i = 0; i < image_width; i++) {
+            auto index = static_cast<size_t>(j) * image_width + i;
+            int samples = progressive.pixel_samples(i, j);
+            values[index] = count_pixels ? (samples > 0 ? pixel_counts[index] / samples : 0.0f) : static_cast<float>(samples);
+        }
+    }
+    return heatmap_image(values, image_width, image_height, settings.debug);
 }
 
-HittableList cornell_smoke() {
-    HittableList objects;
+/// @brief Renders every built-in scene (or just `only_scene`, a built-in
+///        name or a scene file) at a fixed size and sample count: once with
+///        the wavefront integrator, for ray counts and stage times, then
+///        with the recursive one at 1, 2, 4, ...
+///        threads up to `max_threads`. Both integrators trace the same paths,
+///        so the wavefront ray counts hold for the recursive runs too; the
+///        images are compared to make sure they still do.
+/// @param json_path Where the JSON report goes, "-" for stdout
+/// @param light_selection How both integrators pick shadow ray lights
+int run_benchmark(
+    __F_IN__ const std::string &json_path,
+    __F_IN__ const std::string &only_scene,
+    __F_IN__ int width,
+    __F_IN__ int samples_per_pixel,
+    __F_IN__ int max_threads,
+    __F_IN__ LightSelection light_selection
+) {
+    using clock = std::chrono::high_resolution_clock;
+    auto ms_between = [](clock::time_point a, clock::time_point b) {
+        return std::chrono::duration<double, std::milli>(b - a).count();
+    };
+
+    std::vector<std::string> names = builtin_scene_names();
+    if (!only_scene.empty()) {
+        names = { only_scene };
+    }
 
-    auto red = make_shared<Lambertian>(Color(.65, .05, .05));
-    auto green = make_shared<Lambertian>(Color(.12, .45, .15));
-    auto white = make_shared<Lambertian>(Color(.73, .73, .73));
-    auto light = make_shared<DiffuseLight>(Color(7, 7, 7));
+    std::vector<BenchmarkResult> results;
+    for (const auto &name : names) {
+        std::cerr << "Benchmark: " << name << '\n';
 
-    objects.add(make_shared<YZRect>(0, 555, 0, 555, 555, green));
-    objects.add(make_shared<YZRect>(0, 555, 0, 555, 0, red));
-    objects.add(make_shared<XZRect>(113, 443, 127, 432, 554, light));
-    objects.add(make_shared<XZRect>(0, 555, 0, 555, 0, white));
-    objects.add(make_shared<XZRect>(0, 555, 0, 555, 555, white));
-    objects.add(make_shared<XYRect>(0, 555, 0, 555, 555, white));
+        // Scene builders draw random numbers; start them from the same state
+        // every time.
+        thread_rng() = Pcg32();
 
-    shared_ptr<Hittable> box1 = make_shared<Box>(Point3(0, 0, 0), Point3(165, 330, 165), white);
-    box1 = make_shared<RotateY>(box1, 15);
-    box1 = make_shared<Translate>(box1, Vec3(265, 0, 295));
+        BenchmarkResult result;
+        SceneSetup setup;
+        auto build_start = clock::now();
+        if (!builtin_scene(name, setup) && !load_scene_file(name, setup)) {
+            return 1;
+        }
+        result.scene_build_ms = ms_between(build_start, clock::now());
+
+        WideBVH bvh(setup.world, setup.time0, setup.time1);
+        result.bvh = bvh.build_stats;
+        result.inner_bvhs = setup.inner_bvhs;
+        LightSampler lights(*setup.lights, light_selection);
+
+        RenderSettings settings;
+        settings.image_width = width;
+        settings.image_height = static_cast<int>(width / setup.aspect_ratio);
+        settings.samples_per_pixel = samples_per_pixel;
+        settings.max_depth = setup.max_depth;
+        settings.progressive.pass_samples = samples_per_pixel;
+
+        Camera cam(
+            setup.lookfrom, setup.lookat, setup.vup, setup.vfov, setup.aspect_ratio,
+            setup.aperture, setup.focus_dist, setup.time0, setup.time1
+        );
+
+        result.scene = name;
+        result.width = settings.image_width;
+        result.height = settings.image_height;
+        result.samples_per_pixel = samples_per_pixel;
+        result.max_depth = settings.max_depth;
+
+        settings.integrator = Integrator::Wavefront;
+        settings.threads = max_threads;
+        auto start = clock::now();
+        Image wavefront_image = render_image(bvh, lights, cam, setup.background, settings, &result.wavefront, false);
+        result.wavefront_threads = max_threads;
+        result.wavefront_ms = ms_between(start, clock::now());
+
+        settings.integrator = Integrator::Recursive;
+        result.integrators_match = true;
+        for (int threads : benchmark_thread_counts(max_threads)) {
+            settings.threads = threads;
+            start = clock::now();
+            Image image = render_image(bvh, lights, cam, setup.background, settings, nullptr, false);
+            result.recursive.push_back(BenchmarkRun{ threads, ms_between(start, clock::now()) });
+            result.integrators_match = result.integrators_match && image.rgb == wavefront_image.rgb;
+        }
 
-    shared_ptr<Hittable> box2 = make_shared<Box>(Point3(0, 0, 0), Point3(165, 165, 165), white);
-    box2 = make_shared<RotateY>(box2, -18);
-    box2 = make_shared<Translate>(box2, Vec3(130, 0, 65));
+        result.peak_rss_kb = peak_rss_kb();
+        results.push_back(result);
+    }
 
-    objects.add(make_shared<ConstantMedium>(box1, 0.01, Color(0,0,0)));
-    objects.add(make_shared<ConstantMedium>(box2, 0.01, Color(1,1,1)));
-    return objects;
+    std::ofstream file;
+    if (json_path != "-") {
+        file.open(json_path);
+        if (!file) {
+            std::cerr << "ERROR: Could not write " << json_path << '\n';
+            return 1;
+        }
+    }
+    write_benchmark_json(json_path == "-" ? std::cout : file, results, max_threads, light_selection);
+    print_benchmark_summary(std::cerr, results);
+    return 0;
 }
 
-HittableList final_scene() {
-    HittableList boxes1;
-    auto ground = make_shared<Lambertian>(Color(0.48, 0.83, 0.53));
-
-    const int boxes_per_side = 20;
-
-    for (int i = 0; i < boxes_per_side; i++) {
-        for (int j = 0; j < boxes_per_side; j++) {
-            auto w = 100.0;
-            auto x0 = -1000.0 + i * w;
-            auto z0 = -1000.0 + j * w;
-            auto y0 = 0.0;
-            auto x1 = x0 + w;
-            auto y1 = random_double2(1, 101);
-            auto z1 = z0 + w;
+static void print_usage(const char *program) {
+    std::cerr << "Usage: " << program << " [SCENE] [options]\n"
+              << "  SCENE                       built-in scene name or scene file (default: cornell_box)\n"
+              << "  --list-scenes               print the built-in scene names\n"
+              << "  --width=N --height=N        image size; the height follows the scene's aspect ratio\n"
+              << "  --spp=N                     samples per pixel\n"
+              << "  --depth=N                   maximum path depth\n"
+              << "  --threads=N                 render threads (default: all cores)\n"
+              << "  --output=FILE               .ppm, .pfm or .png, '-' for PPM on stdout (default)\n"
+              << "  --recursive | --wavefront   integrator\n"
+              << "  --no-packets                recursive: trace one camera ray at a time (same image)\n"
+              << "  --light-sampling=MODE       pick shadow ray lights by bvh (default), power or uniform\n"
+              << "  --progressive [--pass-spp=N] [--threshold=E] [--time-budget=SECONDS]\n"
+              << "  --mesh=FILE                 add an .obj, .ply or .rtmesh mesh on the Cornell box's short box\n"
+              << "  --write-mesh-cache=FILE     write the --mesh mesh as an .rtmesh cache\n"
+              << "  --debug=MODE                heatmap instead of radiance: nodes, prims or depth per camera path\n"
+              << "                              (needs RT_ENABLE_STATS; default --spp 4), or samples per pixel\n"
+              << "                              (turns on --progressive)\n"
+              << "  --benchmark[=FILE.json]     benchmark the built-in scenes (or SCENE) at --width (default 160)\n"
+              << "                              and --spp (default 16), up to --threads; JSON to FILE or stdout\n";
+}
 
-            boxes1.add(make_shared<Box>(Point3(x0, y0, z0), Point3(x1, y1, z1), ground));
+int main(int argc, char *argv[]) {
+    // Options
+
+    RenderSettings settings;
+    bool progressive_mode = false;
+    std::string scene_name = "cornell_box";
+    bool scene_given = false;
+    std::string output_path = "-";
+    std::string mesh_path;
+    std::string mesh_cache_path;
+    std::string benchmark_path;
+    int width_override = 0;
+    int height_override = 0;
+    int spp_override = 0;
+    int depth_override = 0;
+    LightSelection light_selection = LightSelection::Bvh;
+
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        auto value = [&](const char *prefix) {
+            return std::atof(arg.c_str() + std::strlen(prefix));
+        };
+        auto count = [&](const char *prefix) {
+            return std::max(0, std::atoi(arg.c_str() + std::strlen(prefix)));
+        };
+
+        if (arg == "--wavefront") {
+            settings.integrator = Integrator::Wavefront;
+        } else if (arg == "--recursive") {
+            settings.integrator = Integrator::Recursive;
+        } else if (arg == "--no-packets") {
+            settings.packets = false;
+        } else if (arg.rfind("--light-sampling=", 0) == 0) {
+            if (!light_selection_from_name(arg.substr(std::strlen("--light-sampling=")), light_selection)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--progressive") {
+            progressive_mode = true;
+        } else if (arg.rfind("--pass-spp=", 0) == 0) {
+            progressive_mode = true;
+            settings.progressive.pass_samples = std::max(1, count("--pass-spp="));
+        } else if (arg.rfind("--threshold=", 0) == 0) {
+            progressive_mode = true;
+            settings.progressive.threshold = value("--threshold=");
+        } else if (arg.rfind("--output=", 0) == 0) {
+            output_path = arg.substr(std::strlen("--output="));
+        } else if (arg.rfind("--time-budget=", 0) == 0) {
+            progressive_mode = true;
+            settings.progressive.time_budget = value("--time-budget=");
+        } else if (arg.rfind("--mesh=", 0) == 0) {
+            mesh_path = arg.substr(std::strlen("--mesh="));
+        } else if (arg.rfind("--write-mesh-cache=", 0) == 0) {
+            mesh_cache_path = arg.substr(std::strlen("--write-mesh-cache="));
+        } else if (arg.rfind("--width=", 0) == 0) {
+            width_override = count("--width=");
+        } else if (arg.rfind("--height=", 0) == 0) {
+            height_override = count("--height=");
+        } else if (arg.rfind("--spp=", 0) == 0) {
+            spp_override = count("--spp=");
+        } else if (arg.rfind("--depth=", 0) == 0) {
+            depth_override = count("--depth=");
+        } else if (arg.rfind("--threads=", 0) == 0) {
+            settings.threads = count("--threads=");
+        } else if (arg.rfind("--debug=", 0) == 0) {
+            if (!debug_mode_from_name(arg.substr(std::strlen("--debug=")), settings.debug)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--benchmark") {
+            benchmark_path = "-";
+        } else if (arg.rfind("--benchmark=", 0) == 0) {
+            benchmark_path = arg.substr(std::strlen("--benchmark="));
+        } else if (arg == "--list-scenes") {
+            for (const auto &name : builtin_scene_names()) {
+                std::cout << name << '\n';
+            }
+            return 0;
+        } else if (arg.rfind("--", 0) != 0 && a == 1) {
+            scene_name = arg;
+            scene_given = true;
+        } else {
+            print_usage(argv[0]);
+            return 1;
         }
     }
 
-    HittableList objects;
-
-    objects.add(make_shared<BVHNode>(boxes1, 0, 1));
-
-    auto light = make_shared<DiffuseLight>(Color(7, 7, 7));
-    objects.add(make_shared<XZRect>(123, 423, 147, 412, 554, light));
-
-    auto center1 = Point3(400, 400, 200);
-    auto center2 = center1 + Vec3(30, 0, 0);
-
-    auto moving_sphere_material = make_shared<Lambertian>(Color(0.7, 0.3, 0.1));
-    objects.add(make_shared<MovingSphere>(center1, center2, 0, 1, 50, moving_sphere_material));
-
-    objects.add(make_shared<Sphere>(Point3(260, 150, 45), 50, make_shared<Dielectric>(1.5)));
-
-    objects.add(make_shared<Sphere>(Point3(0, 150, 145), 50, make_shared<Metal>(Color(0.8, 0.8, 0.9), 1.0)));
-
-    auto boundary = make_shared<Sphere>(Point3(360, 150, 145), 70, make_shared<Dielectric>(1.5));
-    objects.add(boundary);
-    objects.add(make_shared<ConstantMedium>(boundary, 0.2, Color(0.2, 0.4, 0.9)));
-    boundary = make_shared<Sphere>(Point3(0, 0, 0), 5000, make_shared<Dielectric>(1.5));
-    objects.add(make_shared<ConstantMedium>(boundary, .0001, Color(1, 1, 1)));
-
-    auto emat = make_shared<Lambertian>(make_shared<ImageTexture>("assets/earthmap.jpg"));
-    objects.add(make_shared<Sphere>(Point3(400, 200, 400), 100, emat));
-
-    auto pertext = make_shared<NoiseTexture>(0.1);
-    objects.add(make_shared<Sphere>(Point3(220, 280, 300), 80, make_shared<Lambertian>(pertext)));
-
-    HittableList boxes2;
-
-    auto white = make_shared<Lambertian>(Color(.73, .73, .73));
-    int ns = 1000;
-
-    for (int j = 0; j < ns; j++) {
-        boxes2.add(make_shared<Sphere>(Point3::random(0, 165), 10, white));
+#ifndef RT_ENABLE_STATS
+    if (debug_mode_needs_stats(settings.debug)) {
+        std::cerr << "ERROR: The nodes, prims and depth heatmaps need a build with RT_ENABLE_STATS.\n";
+        return 1;
+    }
+#endif
+    if (settings.debug == DebugMode::Samples) {
+        progressive_mode = true;
     }
 
-    objects.add(make_shared<Translate>(
-        make_shared<RotateY>(
-            make_shared<BVHNode>(boxes2, 0.0, 1.0), 15),
-            Vec3(-100, 270, 395)
-        )
-    );
-
-    return objects;
-}
-
-HittableList huh() {
-    HittableList boxes1;
-    auto ground = make_shared<Lambertian>(Color(0.48, 0.83, 0.53));
+    if (!benchmark_path.empty()) {
+        int max_threads = settings.threads > 0 ? settings.threads : static_cast<int>(std::thread::hardware_concurrency());
+        return run_benchmark(
+            benchmark_path, scene_given ? scene_name : "",
+            width_override > 0 ? width_override : 160, spp_override > 0 ? spp_override : 16, std::max(1, max_threads),
+            light_selection
+        );
+    }
 
-    const int boxes_per_side = 20;
+    // World
 
-    for (int i = 0; i < boxes_per_side; i++) {
-        for (int j = 0; j < boxes_per_side; j++) {
-            auto w = 100.0;
-            auto x0 = -1000.0 + i * w;
-            auto z0 = -1000.0 + j * w;
-            auto y0 = 0.0;
-            auto x1 = x0 + w;
-            auto y1 = random_double2(1, 101);
-            auto z1 = z0 + w;
+    SceneSetup setup;
+    if (!builtin_scene(scene_name, setup) && !load_scene_file(scene_name, setup)) {
+        return 1;
+    }
 
-            boxes1.add(make_shared<Box>(Point3(x0, y0, z0), Point3(x1, y1, z1), ground));
+    // A mesh given on the command line is scaled to 150 units and set on
+    // top of the Cornell box's short box. A mesh cache holds the mesh as
+    // already placed, BVH included, and is used as is.
+    if (!mesh_path.empty()) {
+        auto mesh = load_triangle_mesh(
+            mesh_path, make_shared<Lambertian>(Color(.73, .73, .73)), Point3(212, 165, 147), 150, mesh_cache_path
+        );
+        if (!mesh) {
+            return 1;
         }
+        setup.world.add(mesh);
     }
 
-    HittableList objects;
-
-    objects.add(make_shared<BVHNode>(boxes1, 0, 1));
-
-    auto light = make_shared<DiffuseLight>(Color(7, 7, 7));
-    objects.add(make_shared<XZRect>(123, 423, 147, 412, 554, light));
-
-    objects.add(make_shared<Sphere>(Point3(220, 280, 300), 200, make_shared<Dielectric>(1.5)));
-
-    return objects;
-}
-
-int main() {
-    // Image
-
-    auto aspect_ratio = 16.0 / 9.0;
-    int image_width = 500;
-    const int max_depth = 50;
-
-    // World
-    
-    HittableList world;
-    Point3 lookfrom;
-    Point3 lookat;
-    auto vfov = 40.0;
-    auto aperture = 0.0;
-    int samples_per_pixel = 500;
-    Color background(0, 0, 0);
-    auto time0 = 0.0;
-    auto time1 = 1.0;
-    auto lights = make_shared<HittableList>();
-    world = cornell_box();
-    lights->add(make_shared<XZRect>(213, 343, 227, 332, 554, shared_ptr<Material>()));
-    // lights->add(make_shared<Sphere>(Point3(190, 90, 190), 90, shared_ptr<Material>()));
-    aspect_ratio = 1.0;
-    image_width = 600;
-    samples_per_pixel = 100;
-    background = Color(0, 0, 0);
-    lookfrom = Point3(278, 278, -800);
-    lookat = Point3(278, 278, 0);
-    vfov = 40.0;
-
-    // switch (6)
-    // {
-    //     case 1:
-    //     {
-    //         world = random_scene();
-    //         background = Color(0.7, 0.8, 1.0);
-    //         lookfrom = Point3(13, 2, 3);
-    //         lookat = Point3(0, 0, 0);
-    //         vfov = 20.0;
-    //         aperture = 0.1;
-    //         break;
-    //     }
-        
-    //     case 2:
-    //     {
-    //         world = two_spheres();
-    //         background = Color(0.7, 0.8, 1.0);
-    //         lookfrom = Point3(13, 2, 3);
-    //         lookat = Point3(0, 0, 0);
-    //         vfov = 20.0;
-    //         break;
-    //     }
-
-    //     case 3:
-    //     {
-    //         world = two_perlin_spheres();
-    //         background = Color(0, 0, 0);
-    //         lookfrom = Point3(478, 278, -600);
-    //         lookat = Point3(278, 278, 0);
-    //         vfov = 40.0;
-    //         break;
-    //     }
-
-    //     case 4:
-    //     {
-    //         world = earth();
-    //         lookfrom = Point3(13, 2, 3);
-    //         background = Color(0.7, 0.8, 1.0);
-    //         lookat = Point3(0, 0, 0);
-    //         vfov = 20.0;
-    //         break;
-    //     }
-
-    //     case 5:
-    //     {
-    //         world = simple_light();
-    //         samples_per_pixel = 400;
-    //         background = Color(0.0, 0.0, 0.0);
-    //         lookfrom = Point3(26, 3, 6);
-    //         lookat = Point3(0, 2, 0);
-    //         vfov = 20.0;
-    //     }
-
-    //     case 6:
-    //     {
-    //         world = cornell_box();
-    //         lights->add(make_shared<XZRect>(213, 343, 227, 332, 554, shared_ptr<Material>()));
-    //         aspect_ratio = 1.0;
-    //         image_width = 600;
-    //         samples_per_pixel = 100;
-    //         background = Color(0, 0, 0);
-    //         lookfrom = Point3(278, 278, -800);
-    //         lookat = Point3(278, 278, 0);
-    //         vfov = 40.0;
-    //         break;
-    //     }
-
-    //     case 7:
-    //     {
-    //         world = cornell_smoke();
-    //         aspect_ratio = 1.0;
-    //         image_width = 600;
-    //         samples_per_pixel = 200;
-    //         lookfrom = Point3(278, 278, -800);
-    //         lookat = Point3(278, 278, 0);
-    //         vfov = 40.0;
-    //         break;
-    //     }
-
-    //     case 8:
-    //     {
-    //         world = final_scene();
-    //         aspect_ratio = 1.0;
-    //         image_width = 800;
-    //         samples_per_pixel = 10000;
-    //         background = Color(0, 0, 0);
-    //         lookfrom = Point3(478, 278, -600);
-    //         lookat = Point3(278, 278, 0);
-    //         vfov = 40.0;
-    //         break;
-    //     }
-
-    //     default:
-    //     {
-    //         world = huh();
-    //         samples_per_pixel = 2000;
-    //         background = Color(0, 0, 0);
-    //         lookfrom = Point3(478, 278, -600);
-    //         lookat = Point3(278, 278, 0);
-    //         vfov = 40.0;
-    //         break;
-    //     }
-    // }
-
-
-    // HittableList world;
-
-    // auto material_ground = make_shared<Lambertian>(Color(0.8, 0.8, 0.0));
-    // auto material_center = make_shared<Lambertian>(Color(0.1, 0.2, 0.5));
-    // auto material_left = make_shared<Dielectric>(1.33);
-    // auto material_right = make_shared<Metal>(Color(0.8, 0.6, 0.2), 1.0);
-    
-    // world.add(make_shared<Sphere>(Point3(0, -100.5, -1), 100, material_ground));
-    // world.add(make_shared<Sphere>(Point3(0, 0, -1), 0.5, material_center));
-    // world.add(make_shared<Sphere>(Point3(-1.0, 0.0, -1.0), 0.5, material_left));
-    // world.add(make_shared<Sphere>(Point3(-1.0, 0.0, -1.0), -0.4, material_left));
-    // world.add(make_shared<Sphere>(Point3(1.0, 0.0, -1.0), 0.5, material_right));
-
-    // auto R = cos(PI / 4);
-
-    // auto material_left = make_shared<Lambertian>(Color(0, 0, 1));
-    // auto material_right = make_shared<Lambertian>(Color(1, 0, 0));
+    settings.image_width = width_override > 0 ? width_override : setup.image_width;
+    settings.image_height = height_override > 0 ? height_override : static_cast<int>(settings.image_width / setup.aspect_ratio);
+    settings.samples_per_pixel = spp_override > 0 ? spp_override : setup.samples_per_pixel;
+    if (spp_override == 0 && debug_mode_needs_stats(settings.debug)) {
+        // A few paths per pixel show the traversal cost well enough and keep
+        // the heatmaps interactive.
+        settings.samples_per_pixel = std::min(settings.samples_per_pixel, 4);
+    }
+    settings.max_depth = depth_override > 0 ? depth_override : setup.max_depth;
+    if (!progressive_mode) {
+        settings.progressive.pass_samples = settings.samples_per_pixel;
+    }
 
-    // world.add(make_shared<Sphere>(Point3(-R, 0, -1), R, material_left));
-    // world.add(make_shared<Sphere>(Point3(R, 0, -1), R, material_right));
-    
     // Camera
 
-    Vec3 vup(0, 1, 0);
-    auto dist_to_focus = 10.0;
-    int image_height = static_cast<int>(image_width / aspect_ratio);
+    auto aspect_ratio = height_override > 0 ? static_cast<double>(settings.image_width) / settings.image_height : setup.aspect_ratio;
+    Camera cam(
+        setup.lookfrom, setup.lookat, setup.vup, setup.vfov, aspect_ratio,
+        setup.aperture, setup.focus_dist, setup.time0, setup.time1
+    );
 
-    Camera cam(lookfrom, lookat, vup, vfov, aspect_ratio, aperture, dist_to_focus, time0, time1);
+    auto scene_bvh = make_shared<WideBVH>(setup.world, setup.time0, setup.time1);
+    for (const auto &inner : setup.inner_bvhs) {
+        std::cerr << inner.name << " BVH: " << inner.stats << '\n';
+    }
+    std::cerr << "Scene BVH: " << scene_bvh->build_stats << '\n';
+    LightSampler lights(*setup.lights, light_selection);
+    std::cerr << "Light BVH: " << lights.build_stats << '\n';
 
     // Render
 
-    std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
-
     auto last_counter = std::chrono::high_resolution_clock::now();
 
-    // for (int j = image_height - 1; j >= 0; --j) {
-    //     std::cerr << "\nScanlines remaining: " << j << ' ' << std::flush;
-    //     for (int i = 0; i < image_width; ++i) {
-    //         Color pixel_color(0, 0, 0);
-
-    //         for (int s = 0; s < samples_per_pixel; ++s) {
-    //             auto u = (i + random_double2()) / (image_width - 1);
-    //             auto v = (j + random_double2()) / (image_height - 1);
-    //             Ray r = cam.get_ray(u, v);
-    //             pixel_color += ray_color(r, world, max_depth);
-    //         }
-
-    //         write_color(std::cout, pixel_color, samples_per_pixel);
-    //     }
-    //     auto stop = std::chrono::high_resolution_clock::now();
-    //     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - last_counter);
-    //     std::cerr << "\nTook: " << duration.count() << "ms" << std::flush;
-    //     last_counter = stop;
-    // }
-
-
-    ctpl::thread_pool p(std::thread::hardware_concurrency());
+    Image image = render_image(*scene_bvh, lights, cam, setup.background, settings, nullptr, true);
 
-    long long total_time = 0;
-
-    // std::map<std::pair<int, int>, Color> pixels;
-
-    for (int j = image_height - 1; j >= 0; --j) {
-        std::cerr << "\nScanlines remaining: " << j << ' ' << std::flush;
-        std::vector<std::pair<std::pair<int, int>, Color>> pixels(image_width);
-        std::vector<std::future<std::pair<std::pair<int, int>, Color>>> results(image_width);
-        
-        for (int i = 0; i < image_width; ++i) {
-            results[i] = p.push([i, j, &world, &cam, samples_per_pixel, max_depth, image_width, image_height, &background, &lights](int) {
-                Color pixel_color(0, 0, 0);
-
-                for (int s = 0; s < samples_per_pixel; s++) {
-                    auto u = (i + random_double2()) / (image_width - 1);
-                    auto v = (j + random_double2()) / (image_height - 1);
-                    Ray r = cam.get_ray(u, v);
-                    pixel_color += ray_color(r, background, world, lights, max_depth);
-                }
-
-                std::pair<std::pair<int, int>, Color> pix = std::make_pair(std::make_pair(j, i), pixel_color);
-                // std::cerr << "(" << pix.first.first << ", " << pix.first.second << "), " << pix.second.e[0] << ", " << pix.second.e[1] << ", " << pix.second.e[2] << std::endl;
-                return pix;
-            });
-        }
-
-        // for (auto& result : results) {
-        //     std::cerr << "getting result" << std::flush;
-        //     result.get();
-        // }
-        
-        for (int i = 0; i < image_width; ++i) {
-            pixels[i] = results[i].get();
-        }
-
-        results.clear();
-
-        std::sort(pixels.begin(), pixels.end(), [](const std::pair<std::pair<int, int>, Color> &a, const std::pair<std::pair<int, int>, Color> &b) {
-            if (a.first.first == b.first.first) {
-                return a.first.second < b.first.second;
-            }
-            return a.first.first > b.first.first;
-        });
-
-        for (auto& pixel : pixels) {
-            write_color(std::cout, pixel.second, samples_per_pixel);
-        }
-
-        auto end_counter = std::chrono::high_resolution_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_counter - last_counter);
-        std::cerr << "\nTook: " << duration.count() << "ms" << std::flush;
-        total_time += duration.count();
-        last_counter = end_counter;
-        pixels.clear();
+    auto output_start = std::chrono::high_resolution_clock::now();
+    if (!write_image(image, image_format_from_path(output_path), output_path)) {
+        std::cerr << "Could not write " << output_path << '\n';
+        return 1;
     }
 
+    auto end_counter = std::chrono::high_resolution_clock::now();
+    long long total_time = std::chrono::duration_cast<std::chrono::milliseconds>(end_counter - last_counter).count();
+    double output_ms = std::chrono::duration<double, std::milli>(end_counter - output_start).count();
+
+    std::cerr << "Output: " << output_path << " in " << output_ms << "ms\n";
     std::cerr << "\nDone.\n";
     std::cerr << "Total time: " << total_time << "ms / " << total_time / 1000.0 << "s" << std::endl;
 }